@@ -0,0 +1,52 @@
+#ifndef BASIL_ARENA_H
+#define BASIL_ARENA_H
+
+#include "defs.h"
+#include "vec.h"
+
+namespace basil {
+
+    // A region that a compilation unit's Terms and Nodes are bump-allocated
+    // from. Nothing in it is freed on its own - objects registered with
+    // own() have their destructors run, newest first, and all of the memory
+    // goes back in one step when the arena is released.
+    class Arena {
+        struct Finalizer {
+            void (*destroy)(void*);
+            void* object;
+            Finalizer* next;
+        };
+
+        vector<u8*> _blocks;
+        u8 *_next, *_end;
+        Finalizer *_first, *_last;
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+    public:
+        Arena();
+        ~Arena();
+
+        void* alloc(u64 size);
+        void own(void* object, void (*destroy)(void*));
+        void absorb(Arena& other);
+        void release();
+    };
+
+    // Sets the arena this thread allocates Terms and Nodes from, returning
+    // the one it replaces.
+    Arena* useArena(Arena* arena);
+    Arena* currentArena();
+
+    // Allocates memory for a T from the current arena, which must be set.
+    // The object's destructor runs when the arena is released.
+    template<typename T>
+    void* arenaAlloc(u64 size) {
+        Arena* arena = currentArena();
+        void* p = arena->alloc(size);
+        arena->own(p, [](void* object) { ((T*)object)->~T(); });
+        return p;
+    }
+}
+
+#endif
@@ -2,8 +2,10 @@
 #define BASIL_AST_H
 
 #include "defs.h"
+#include <cstddef>
 #include "utf8.h"
 #include "meta.h"
+#include "env.h"
 
 namespace basil {
     class Node {
@@ -12,8 +14,13 @@ namespace basil {
         Node(u32 line, u32 column);
         virtual ~Node();
 
+        // nodes live in the current arena, and are freed along with it
+        static void* operator new(size_t size);
+        static void operator delete(void* p);
+
         u32 line() const;
         u32 column() const;
+        virtual bool isConstant() const;
         virtual Meta eval(Env* env) = 0;
     };
 
@@ -22,6 +29,7 @@ namespace basil {
     public:
         Int(i64 value, u32 line, u32 column);
 
+        virtual bool isConstant() const override;
         virtual Meta eval(Env* env) override;
     };
 
@@ -30,6 +38,7 @@ namespace basil {
     public:
         Float(double value, u32 line, u32 column);
 
+        virtual bool isConstant() const override;
         virtual Meta eval(Env* env) override;
     };
 
@@ -38,6 +47,7 @@ namespace basil {
     public:
         String(const ustring& value, u32 line, u32 column);
 
+        virtual bool isConstant() const override;
         virtual Meta eval(Env* env) override;
     };
 
@@ -46,6 +56,7 @@ namespace basil {
     public:
         Char(uchar value, u32 line, u32 column);
 
+        virtual bool isConstant() const override;
         virtual Meta eval(Env* env) override;
     };
 
@@ -57,10 +68,13 @@ namespace basil {
         virtual Meta eval(Env* env) override;
     };
 
+    // variables resolved while lowering keep where they'll be found, and
+    // only fall back to looking up their name if it isn't there
     class Variable : public Node {
-        ustring _name;
+        i64 _name;
+        Address _address;
     public:
-        Variable(const ustring& name, u32 line, u32 column);
+        Variable(i64 name, const Address& address, u32 line, u32 column);
 
         virtual Meta eval(Env* env) override;
     };
@@ -70,11 +84,15 @@ namespace basil {
     public:
         Constant(const Meta& value, u32 line, u32 column);
 
+        virtual bool isConstant() const override;
         virtual Meta eval(Env* env) override;
     };
 
+    // The quoted value is built once, when the node is made. It's shared by
+    // every evaluation, so anything that would modify it must clone it.
     class Quote : public Node {
         Term* _term;
+        Meta _value;
     public:
         Quote(Term* term, u32 line, u32 column);
 
@@ -83,12 +101,11 @@ namespace basil {
 
     class Define : public Node {
         Node* _type;
-        vector<ustring> _names;
+        vector<i64> _names;
         Node* _init;
     public:
-        Define(Node* _type, const vector<ustring>& names, Node* init, u32 line, u32 column);
-        Define(const vector<ustring>& names, Node* init, u32 line, u32 column);
-        ~Define();
+        Define(Node* _type, const vector<i64>& names, Node* init, u32 line, u32 column);
+        Define(const vector<i64>& names, Node* init, u32 line, u32 column);
 
         virtual Meta eval(Env* env) override;
     };
@@ -97,20 +114,22 @@ namespace basil {
         vector<Node*> _body;
     public:
         Do(const vector<Node*>& body);
-        ~Do();
 
         virtual Meta eval(Env* env) override;
     };
 
     class Lambda : public Node {
-        Env* _local;
+        Env* _layout;
         Node* _type;
         vector<Node*> _args;
+        vector<i64> _locals; // arguments first, in slot order
+        vector<Node*> _captures; // evaluated where the closure is created
         Node* _body;
     public:
-        Lambda(Node* type, const vector<Node*>& args, Node* body, u32 line, u32 column);
-        Lambda(const vector<Node*>& args, Node* body, u32 line, u32 column);
-        ~Lambda();
+        Lambda(Node* type, const vector<Node*>& args, const vector<i64>& locals, 
+            const vector<Node*>& captures, Node* body, u32 line, u32 column);
+        Lambda(const vector<Node*>& args, const vector<i64>& locals, 
+            const vector<Node*>& captures, Node* body, u32 line, u32 column);
 
         virtual Meta eval(Env* env) override;
     };
@@ -120,7 +139,6 @@ namespace basil {
         vector<Node*> _args;
     public:
         Call(Node* func, const vector<Node*>& args, u32 line, u32 column);
-        ~Call();
 
         virtual Meta eval(Env* env) override;
     };
@@ -129,7 +147,6 @@ namespace basil {
         vector<Node*> _params;
     public:
         Add(const vector<Node*>& params, u32 line, u32 column);
-        ~Add();
 
         virtual Meta eval(Env* env) override;
     };
@@ -138,7 +155,6 @@ namespace basil {
         vector<Node*> _params;
     public:
         Subtract(const vector<Node*>& params, u32 line, u32 column);
-        ~Subtract();
 
         virtual Meta eval(Env* env) override;
     };
@@ -147,7 +163,6 @@ namespace basil {
         vector<Node*> _params;
     public:
         Multiply(const vector<Node*>& params, u32 line, u32 column);
-        ~Multiply();
 
         virtual Meta eval(Env* env) override;
     };
@@ -156,7 +171,6 @@ namespace basil {
         vector<Node*> _params;
     public:
         Divide(const vector<Node*>& params, u32 line, u32 column);
-        ~Divide();
 
         virtual Meta eval(Env* env) override;
     };
@@ -10,24 +10,88 @@ namespace basil {
         Meta meta;
     };
     
+    // Entries are kept densely in the order they were entered, so a slot
+    // number stays valid for the life of the environment. Names are symbol
+    // ids, and map to slots through a separate index. Entry pointers are 
+    // only good until the next call to enter().
+    //
+    // Function bodies run in frames instead, pushed for every call onto a
+    // per-thread stack. A frame has a fixed set of slots named after its
+    // function's layout, and sees the values captured by its closure. Its
+    // parent is the scope around the outermost function, never a frame.
     class Env {
-        map<ustring, Entry> _entries;
-        vector<pair<ustring, Entry>*> _entryOrder;
+        struct Table {
+            vector<Entry> entries;
+            vector<i64> names;
+            map<i64, u32> index;
+        };
+
+        Table* _table; // null in frames
+        const Table* _layout;
+        Entry* _slots;
+        u32 _nslots;
+        const Meta* _captures;
+        u32 _ncaptures;
         Env* _parent;
+
+        Env(const Env* layout, Entry* slots, Env* parent, 
+            const Meta* captures, u32 ncaptures);
+        Env(const Env&) = delete;
+        Env& operator=(const Env&) = delete;
+
+        friend Env* pushFrame(const Env*, Env*, const Meta*, u32);
+        friend void popFrame(Env*);
     public:
         Env();
+        ~Env();
 
         void setParent(Env* parent);
         Env* parent() const;
+        u32 size() const;
+        i64 name(u32 i) const;
+        i64 slot(i64 name) const;
         Entry* entry(u32 i);
         const Entry* entry(u32 i) const;
-        Entry* lookup(const ustring& name);
-        const Entry* lookup(const ustring& name) const;
-        void enter(const ustring& name, const Meta& meta);
-        Env* fork() const;
-        map<ustring, Entry>& entries();
-        const map<ustring, Entry>& entries() const;
+        Entry* lookup(i64 name);
+        const Entry* lookup(i64 name) const;
+        void enter(i64 name, const Meta& meta);
+        bool isFrame() const;
+        const Meta* capture(u32 i) const;
+    };
+
+    // Pushes a frame with a slot for each name in 'layout', starting out 
+    // as copies of its entries, onto this thread's frame stack. Frames are
+    // popped in the reverse order they were pushed, and nothing may point
+    // into one once it's popped.
+    Env* pushFrame(const Env* layout, Env* parent, const Meta* captures, u32 ncaptures);
+    void popFrame(Env* frame);
+
+    // Where a variable will be found when it's evaluated - a slot some
+    // number of parents up from the current environment, or one of the
+    // values captured by the function it appears in.
+    struct Address {
+        enum Mode { UNBOUND, SLOT, CAPTURE } mode;
+        u32 depth, index;
+    };
+
+    // While a function is lowered, the names it binds are tracked in the
+    // order they'll be entered into its environment, innermost function
+    // last. Variables can then be resolved to a fixed place up front, and
+    // names from enclosing functions are recorded as captures, in the order
+    // they're first used.
+    struct Scope {
+        vector<i64> names, captures;
     };
+
+    void pushScope();
+    Scope popScope();
+    void bindLocal(i64 name);
+    bool isLocal(i64 name);
+
+    // Finds where 'name' will be found from the innermost scope being 
+    // lowered against 'env', capturing it if it belongs to an enclosing
+    // function. The mode is UNBOUND if it isn't bound yet.
+    Address locate(const Env* env, i64 name);
 }
 
 #endif
\ No newline at end of file
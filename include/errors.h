@@ -21,14 +21,15 @@ namespace basil {
 
     void prefixPhase(buffer& b, Phase phase);
     void reportError(const Error& error);
-    void useSource(Source* src);
-    Source* currentSource();
+    void useSource(const Source* src);
+    const Source* currentSource();
     u32 countErrors();
     void printErrors(stream& io);
 
     void catchErrors();
     void releaseErrors();
     void discardErrors();
+    vector<Error> takeErrors();
     Error& lastError();
 
     template<typename... Args>
@@ -7,28 +7,42 @@
 class stream {
 public:
     virtual void write(u8 c) = 0;
+    virtual void write(const u8* data, u32 size);
     virtual u8 read() = 0; 
+    virtual u32 read(u8* data, u32 size);
     virtual u8 peek() const = 0;
     virtual void unget(u8 c) = 0;
+    virtual void flush();
     virtual operator bool() const = 0;
 };
 
 bool exists(const char* path);
 
+constexpr u32 FILE_BUFFER_KB = 64;
+
 class file : public stream {
     FILE* f;
-    bool done;
+    int fd;
+    u8 *rbuf, *wbuf;
+    u32 _bufsize, _rcapacity, _wend;
+    mutable u32 _rstart, _rend;
+    mutable bool done;
+
+    bool refill() const;
 public:
-    file(const char* fname, const char* flags);
-    file(FILE* f_in);
+    file(const char* fname, const char* flags, u32 kb = FILE_BUFFER_KB);
+    file(FILE* f_in, u32 kb = FILE_BUFFER_KB);
     ~file();
     file(const file& other) = delete;
     file& operator=(const file& other) = delete;
 
     void write(u8 c) override;
+    void write(const u8* data, u32 size) override;
     u8 read() override;
+    u32 read(u8* data, u32 size) override;
     u8 peek() const override;
     void unget(u8 c) override;
+    void flush() override;
     operator bool() const override;
 };
 
@@ -48,7 +62,9 @@ public:
     buffer& operator=(const buffer& other);
 
     void write(u8 c) override;
+    void write(const u8* data, u32 size) override;
     u8 read() override;
+    u32 read(u8* data, u32 size) override;
     u8 peek() const override;
     void unget(u8 c) override;
     u32 size() const;
@@ -58,10 +74,11 @@ public:
     const u8* begin() const;
     u8* end();
     const u8* end() const;
+
+    friend void write(stream& io, const buffer& b);
 };
 
 extern stream &_stdin, &_stdout;
-void setprecision(u32 p);
 
 void write(stream& io, u8 c);
 void write(stream& io, u16 n);
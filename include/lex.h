@@ -18,24 +18,44 @@ namespace basil {
         T_LBRACK = 9,  // [
         T_RBRACK = 10; // ]
 
+    // tokens don't own any text; they point back into the source, and only
+    // literals and identifiers carry a decoded payload
     struct Token {
-        ustring name;
-        u32 id, line, column;
+        u32 id, offset, length;
+        union {
+            i64 intval;      // T_INT
+            double floatval; // T_FLOAT
+            i64 symbol;      // T_IDENT, or T_STRING with escapes (-1 if none)
+            u8 charval[4];   // T_CHAR
+        };
 
         operator bool() const;
     };
 
+    // pulls tokens from the lexer as the parser asks for them, keeping
+    // only the most recently read token around for rewind()
     struct TokenView {
-        vector<Token>& _cache;
+        Source::View _source;
+        vector<Token> _cache;
         u32 index;
+        mutable Source::View _cursor;
+
+        bool fill();
     public:
-        TokenView(vector<Token>& cache);
-        const Token& peek() const;
+        TokenView(const Source::View& source);
+        const Token& peek();
         const Token& read();
         void rewind();
+        u32 line(const Token& t) const;
+        u32 column(const Token& t) const;
+        const_slice<u8> text(const Token& t) const;
     };
 
     Token lex(Source::View& view);
+
+    // offsets of line starts that fall between top-level forms, spaced at
+    // least 'target' bytes apart
+    vector<u32> splitForms(const Source& src, u32 target);
 }
 
 void write(stream& io, const basil::Token& token);
@@ -2,6 +2,7 @@
 #define BASIL_META_H
 
 #include "defs.h"
+#include <cstddef>
 #include "vec.h"
 #include "hash.h"
 #include "utf8.h"
@@ -151,19 +152,31 @@ namespace basil {
         Meta clone(const Meta& src) const override;
     };
 
+    // A closure is a single allocation - the values it captures are stored
+    // right after the object. Calls push a frame laid out like its lambda's
+    // arguments and locals, parented to the closure's scope.
     class MetaFunction : public MetaRC {
         Node* fn;
         Builtin _builtin;
-        vector<u32> _args;
-        Env* _local;
+        const Env* _layout;
+        Env* _scope;
+        u32 _ncaptures;
     public:
-        MetaFunction(Node* function, const vector<u32>& args, Env* local);
+        static void* operator new(size_t size);
+        static void* operator new(size_t size, u32 ncaptures);
+        static void operator delete(void* p);
+        static void operator delete(void* p, u32 ncaptures);
+
+        MetaFunction(Node* function, const Env* layout, Env* scope, 
+            const Meta* captures, u32 ncaptures);
         MetaFunction(Builtin builtin);
         ~MetaFunction();
         Node* function() const;
         Builtin builtin() const;
-        Entry* arg(u32 i) const;
-        Env* local() const;
+        const Env* layout() const;
+        Env* scope() const;
+        const Meta* captures() const;
+        u32 ncaptures() const;
         Meta clone(const Meta& src) const override;
     };
 
@@ -0,0 +1,20 @@
+#ifndef BASIL_NUM_H
+#define BASIL_NUM_H
+
+#include "defs.h"
+#include "slice.h"
+
+// Each of these writes the decimal form of a number into 'out' and returns
+// the number of bytes written, or zero if 'out' is smaller than 
+// NUMBER_BUFFER_SIZE. Floats are written with the shortest digits that 
+// still read back as the same value (Grisu2, which finds the shortest
+// form in all but a tiny fraction of cases, and always round-trips).
+
+constexpr u32 NUMBER_BUFFER_SIZE = 32;
+
+u32 format_unsigned(slice<u8> out, u64 n);
+u32 format_signed(slice<u8> out, i64 n);
+u32 format_float(slice<u8> out, float f);
+u32 format_float(slice<u8> out, double d);
+
+#endif
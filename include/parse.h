@@ -5,6 +5,7 @@
 #include "vec.h"
 #include "utf8.h"
 #include "ast.h"
+#include "errors.h"
 
 namespace basil {
     class Term {
@@ -13,20 +14,28 @@ namespace basil {
         Term(u32 line, u32 column);
         virtual ~Term();
 
+        // terms live in the current arena, and are freed along with it. they
+        // only hold plain data, so no destructor needs to run when it is
+        static void* operator new(size_t size);
+        static void operator delete(void* p);
+
         u32 line() const;
         u32 column() const;
+        u64 hash() const;
+        bool equals(const Term* other) const;
+        virtual const BlockTerm* asBlock() const;
         virtual Node* eval(Env* env) const = 0;
         virtual Meta quote() const = 0;
         virtual void format(stream& io) const = 0;
     };
 
     class BlockTerm : public Term {
-        vector<Term*> _terms;
+        const_slice<Term*> _terms;
     public:
-        BlockTerm(const vector<Term*> terms, u32 line, u32 column);
-        ~BlockTerm();
+        BlockTerm(const_slice<Term*> terms, u32 line, u32 column);
 
-        const vector<Term*>& terms() const;
+        const_slice<Term*> terms() const;
+        const BlockTerm* asBlock() const override;
         Node* eval(Env* env) const override;
         Meta quote() const override;
         void format(stream& io) const override;
@@ -62,10 +71,12 @@ namespace basil {
         void format(stream& io) const override;
     };
 
+    // string contents are borrowed, from either the symbol table or the
+    // current arena
     class StringTerm : public Term {
-        ustring _value;
+        const_slice<uchar> _value;
     public:
-        StringTerm(const ustring& value, u32 line, u32 column);
+        StringTerm(const_slice<uchar> value, u32 line, u32 column);
 
         Node* eval(Env* env) const override;
         Meta quote() const override;
@@ -73,16 +84,30 @@ namespace basil {
     };
 
     class VariableTerm : public Term {
-        ustring _name;
+        i64 _name;
     public:
-        VariableTerm(const ustring& name, u32 line, u32 column);
+        VariableTerm(i64 name, u32 line, u32 column);
 
         Node* eval(Env* env) const override;
         Meta quote() const override;
         void format(stream& io) const override;
     };
 
+    // appends 'term' and everything nested in it to 'out', parents first
+    void flatten(const Term* term, vector<const Term*>& out);
+
+    // parses one term from 'view' into the current arena
     Term* parse(TokenView& view);
+
+    // sources at least twice this size are parsed on several threads
+    constexpr u32 PARSE_CHUNK_SIZE = 1 << 20;
+
+    // Parses all of 'src', splitting it between worker threads at top-level
+    // forms. Terms come back in source order up to the first error. Errors 
+    // are returned rather than reported, so the caller can finish with the 
+    // terms in front of them first. Like parse(), the terms are allocated in
+    // the current arena.
+    vector<Term*> parseAll(const Source& src, vector<Error>& errors);
 }
 
 void write(stream& io, const basil::Term* term);
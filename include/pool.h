@@ -0,0 +1,27 @@
+#ifndef BASIL_POOL_H
+#define BASIL_POOL_H
+
+#include "defs.h"
+#include <atomic>
+#include <thread>
+
+// Calls work(i) for every i below 'count', spread over as many threads as
+// the machine has cores. The calling thread does its share, and all of the
+// work is done by the time this returns.
+
+template<typename F>
+void parallel_for(u32 count, const F& work) {
+    std::atomic<u32> claimed(0);
+    auto worker = [&]() {
+        for (u32 i = claimed ++; i < count; i = claimed ++) work(i);
+    };
+    u32 threads = std::thread::hardware_concurrency();
+    if (threads > count) threads = count;
+    std::thread* pool = threads > 1 ? new std::thread[threads - 1] : nullptr;
+    for (u32 i = 0; i + 1 < threads; ++ i) pool[i] = std::thread(worker);
+    worker();
+    for (u32 i = 0; i + 1 < threads; ++ i) pool[i].join();
+    delete[] pool;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef BASIL_SCAN_H
+#define BASIL_SCAN_H
+
+#include "defs.h"
+
+// Classifies each byte of 'data' into two bitmaps, one bit per byte with 
+// the least significant bit first. 'space' marks ASCII whitespace. 
+// 'structural' marks ( ) [ ] " ' # and newlines, along with NUL and every 
+// byte of a multibyte character, since the lexer has to look at those 
+// itself. Bytes past 'size' in the last word read as NUL. Both bitmaps need 
+// room for (size + 63) / 64 words.
+
+void scan_bytes(const u8* data, u32 size, u64* space, u64* structural);
+
+#endif
@@ -6,37 +6,75 @@
 #include "io.h"
 
 namespace basil {
+    constexpr u32 SOURCE_CHUNK_SIZE = 65536;
+
     class Source {
-        ustring text;
+        // text is kept in append-only chunks that are never moved once
+        // written, and no line ever spans two chunks
+        struct Chunk {
+            u8* data;
+            u32 start, size, capacity;
+            u64* space, *structural; // see scan.h
+            u32 scanned;
+        };
+
+        vector<Chunk> chunks;
         vector<u32> lines;
+        u32 _size;
+
         void add(uchar c);
+        void append(const u8* data, u32 size);
+        void reserve(u32 size);
+        const Chunk& chunkOf(u32 offset) const;
+        const u8* data(u32 offset) const;
+        void index();
+        bool map(const char* path);
     public:
         Source();
         Source(stream& f);
         explicit Source(const char* path);
+        ~Source();
+        Source(const Source& other) = delete;
+        Source& operator=(const Source& other) = delete;
 
         class View {
             const Source* src;
-            const uchar* _data;
-            u32 _line, _column;
+            u32 _offset, _end;
+            mutable const u8* _chunk;
+            mutable const u64* _space, *_structural;
+            mutable u32 _lo, _hi;
+            mutable u32 _mark, _markLine, _markColumn;
+
+            bool fetch() const;
+            void locate() const;
         public:
             View(const Source* src_in);
             View(const Source* src_in, u32 line, u32 column);
             
             void rewind();
-            const_slice<uchar> operator[](pair<u32, u32> range) const;
+            void seek(u32 offset);
+            void limit(u32 end);
+            const_slice<u8> operator[](pair<u32, u32> range) const;
             uchar read();
             uchar peek() const;
+            u8 peekByte() const;
+            u32 skip(const u8* table, u8 mask);
+            u32 skipSpace();
+            u32 skipToStructural(bool space);
+            u32 offset() const;
             u32 line() const;
             u32 column() const;
             const Source* source() const;
         };
 
         void load(stream& f);
+        void load(const u8* data, u32 size);
         void add(const ustring& line);
         void add(stream& io);
-        slice<uchar> line(u32 line);
-        const_slice<uchar> line(u32 line) const;  
+        slice<u8> line(u32 line);
+        const_slice<u8> line(u32 line) const;  
+        u32 lineOf(u32 offset) const;
+        const_slice<u8> span(u32 offset, u32 length) const;
         u32 size() const;
         View view() const;
         View expand(stream& io);
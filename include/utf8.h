@@ -32,6 +32,7 @@ bool isalpha(uchar c);
 bool isalnum(uchar c);
 bool issym(uchar c);
 bool isprint(uchar c);
+u32 digitvalue(uchar c);
 
 class ustring {
     uchar* data;
@@ -58,6 +59,7 @@ public:
     ustring& operator+=(const char* s);
     ustring& operator+=(const ustring& s);
     void pop();
+    void clear();
     u32 size() const;
     u32 capacity() const;
     const uchar& operator[](u32 i) const;
@@ -0,0 +1,73 @@
+#include "arena.h"
+#include <cstdlib>
+
+namespace basil {
+    static const u64 ARENA_BLOCK_SIZE = 65536, ARENA_ALIGN = 16;
+
+    Arena::Arena():
+        _next(nullptr), _end(nullptr), _first(nullptr), _last(nullptr) {
+        //
+    }
+
+    Arena::~Arena() {
+        release();
+    }
+
+    void* Arena::alloc(u64 size) {
+        size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+        if (size > u64(_end - _next)) {
+            // oversized requests get a block to themselves, so the current
+            // block can keep filling up
+            if (size > ARENA_BLOCK_SIZE / 4) {
+                u8* block = (u8*)malloc(size);
+                _blocks.push(block);
+                return block;
+            }
+            _next = (u8*)malloc(ARENA_BLOCK_SIZE);
+            _end = _next + ARENA_BLOCK_SIZE;
+            _blocks.push(_next);
+        }
+        void* p = _next;
+        _next += size;
+        return p;
+    }
+
+    void Arena::own(void* object, void (*destroy)(void*)) {
+        Finalizer* f = (Finalizer*)alloc(sizeof(Finalizer));
+        f->destroy = destroy, f->object = object, f->next = _first;
+        _first = f;
+        if (!_last) _last = f;
+    }
+
+    void Arena::absorb(Arena& other) {
+        if (other._first) {
+            other._last->next = _first;
+            _first = other._first;
+            if (!_last) _last = other._last;
+        }
+        for (u8* block : other._blocks) _blocks.push(block);
+        other._blocks.clear();
+        other._next = other._end = nullptr;
+        other._first = other._last = nullptr;
+    }
+
+    void Arena::release() {
+        for (Finalizer* f = _first; f; f = f->next) f->destroy(f->object);
+        for (u8* block : _blocks) free(block);
+        _blocks.clear();
+        _next = _end = nullptr;
+        _first = _last = nullptr;
+    }
+
+    static thread_local Arena* _arena = nullptr;
+
+    Arena* useArena(Arena* arena) {
+        Arena* prev = _arena;
+        _arena = arena;
+        return prev;
+    }
+
+    Arena* currentArena() {
+        return _arena;
+    }
+}
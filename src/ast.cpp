@@ -4,6 +4,7 @@
 #include "meta.h"
 #include "env.h"
 #include "errors.h"
+#include "arena.h"
 
 namespace basil {
 
@@ -17,6 +18,14 @@ namespace basil {
     Node::~Node() {
         //
     }
+
+    void* Node::operator new(size_t size) {
+        return arenaAlloc<Node>(size);
+    }
+
+    void Node::operator delete(void* p) {
+        //
+    }
     
     u32 Node::line() const {
         return _line;
@@ -26,6 +35,10 @@ namespace basil {
         return _column;
     }
 
+    bool Node::isConstant() const {
+        return false;
+    }
+
     // Int
 
     Int::Int(i64 value, u32 line, u32 column):
@@ -33,6 +46,10 @@ namespace basil {
         //
     }
 
+    bool Int::isConstant() const {
+        return true;
+    }
+
     Meta Int::eval(Env* env) {
         return Meta(INT, _value);
     }
@@ -44,6 +61,10 @@ namespace basil {
         //
     }
 
+    bool Float::isConstant() const {
+        return true;
+    }
+
     Meta Float::eval(Env* env) {
         return Meta(FLOAT, _value);
     }
@@ -55,6 +76,10 @@ namespace basil {
         //
     }
 
+    bool String::isConstant() const {
+        return true;
+    }
+
     Meta String::eval(Env* env) {
         return Meta(STRING, _value);
     }
@@ -66,23 +91,38 @@ namespace basil {
         //
     }
 
+    bool Char::isConstant() const {
+        return true;
+    }
+
     Meta Char::eval(Env* env) {
         return Meta(CHAR, _value);
     }
 
     // Variable
 
-    Variable::Variable(const ustring& name, u32 line, u32 column):
-        Node(line, column), _name(name) {
+    Variable::Variable(i64 name, const Address& address, u32 line, u32 column):
+        Node(line, column), _name(name), _address(address) {
         //
     }
 
     Meta Variable::eval(Env* env) {
+        if (_address.mode == Address::CAPTURE) {
+            const Meta* m = env->capture(_address.index);
+            if (m) return *m;
+        }
+        else if (_address.mode == Address::SLOT) {
+            Env* e = env;
+            for (u32 i = 0; i < _address.depth && e; i ++) e = e->parent();
+            if (e && _address.index < e->size() && e->name(_address.index) == _name) 
+                return e->entry(_address.index)->meta;
+        }
+
         Entry* entry = env->lookup(_name);
         if (entry) return entry->meta;
 
         err(PHASE_TYPE, line(), column(),
-            "Undefined variable '", _name, "'.");
+            "Undefined variable '", findSymbol(_name), "'.");
         return Meta();
     }
 
@@ -93,6 +133,10 @@ namespace basil {
         //
     }
 
+    bool Constant::isConstant() const {
+        return true;
+    }
+
     Meta Constant::eval(Env* env) {
         return _value;
     }
@@ -100,31 +144,26 @@ namespace basil {
     // Quote
 
     Quote::Quote(Term* term, u32 line, u32 column):
-        Node(line, column), _term(term) {
+        Node(line, column), _term(term), _value(term->quote()) {
         //
     }
 
     Meta Quote::eval(Env* env) {
-        return _term->quote();
+        return _value;
     }
 
     // Define
 
-    Define::Define(Node* type, const vector<ustring>& names, Node* init, u32 line, u32 column):
+    Define::Define(Node* type, const vector<i64>& names, Node* init, u32 line, u32 column):
         Node(line, column), _type(type), _names(names), _init(init) {
         //
     }
 
-    Define::Define(const vector<ustring>& names, Node* init, u32 line, u32 column):
+    Define::Define(const vector<i64>& names, Node* init, u32 line, u32 column):
         Node(line, column), _type(nullptr), _names(names), _init(init) {
         //
     }
 
-    Define::~Define() {
-        if (_type) delete _type;
-        if (_init) delete _init;
-    }
-
     Meta Define::eval(Env* env) {
         Meta initval = _init ? _init->eval(env) : Meta();
         const Type* type = nullptr;;
@@ -154,7 +193,7 @@ namespace basil {
 
         if (!initval) initval = Meta(find<RuntimeType>(type), (Node*)nullptr);
 
-        for (const ustring& name : _names)
+        for (i64 name : _names)
             env->enter(name, initval);
 
         return initval;
@@ -167,10 +206,6 @@ namespace basil {
         //
     }
 
-    Do::~Do() {
-        for (Node* n : _body) delete n;
-    }
-
     Meta Do::eval(Env* env) {
         for (Node* n : _body) {
             if (n == _body.back())
@@ -182,35 +217,51 @@ namespace basil {
 
     // Lambda
 
-    Lambda::Lambda(Node* type, const vector<Node*>& args, Node* body, u32 line, u32 column):
-        Node(line, column), _type(type), _args(args), _body(body), _local(nullptr) {
+    Lambda::Lambda(Node* type, const vector<Node*>& args, const vector<i64>& locals, 
+        const vector<Node*>& captures, Node* body, u32 line, u32 column):
+        Node(line, column), _type(type), _args(args), _locals(locals), 
+        _captures(captures), _body(body), _layout(nullptr) {
         //
     }
 
-    Lambda::Lambda(const vector<Node*>& args, Node* body, u32 line, u32 column):
-        Node(line, column), _type(nullptr), _args(args), _body(body), _local(nullptr) {
+    Lambda::Lambda(const vector<Node*>& args, const vector<i64>& locals, 
+        const vector<Node*>& captures, Node* body, u32 line, u32 column):
+        Node(line, column), _type(nullptr), _args(args), _locals(locals), 
+        _captures(captures), _body(body), _layout(nullptr) {
         //
     }
 
-    Lambda::~Lambda() {
-        for (Node* n : _args) delete n;
-        if (_type) delete _type;
-        delete _body;
-    }
-
+    // Closures only hold on to the values they capture. Everything else 
+    // they refer to is found from the scope around the outermost function,
+    // which is where their frames are parented.
     Meta Lambda::eval(Env* env) {
-        if (!_local) {
-            _local = new Env();
-            _local->setParent(env);
-            for (Node* n : _args) n->eval(_local);
+        Env* scope = env;
+        while (scope->isFrame()) scope = scope->parent();
+
+        vector<Meta> captured;
+        for (Node* n : _captures) captured.push(n->eval(env));
+
+        // arguments are bound once, to unknown runtime values, and every
+        // frame starts out with them
+        if (!_layout) {
+            _layout = new Env();
+            for (i64 name : _locals) _layout->enter(name, Meta());
+            Env* frame = pushFrame(_layout, scope, nullptr, 0);
+            for (Node* n : _args) n->eval(frame);
+            for (u32 i = 0; i < frame->size(); i ++) 
+                _layout->entry(i)->meta = frame->entry(i)->meta;
+            popFrame(frame);
         }
 
+        // the signature and body are typed in a frame of their own
+        Env* frame = pushFrame(_layout, scope, captured.begin(), captured.size());
+
         vector<const Type*> args;
-        for (auto& entry : _local->entries()) {
-            const Meta& m = entry.second.meta;
+        for (u32 i = 0; i < frame->size(); i ++) {
+            const Meta& m = frame->entry(i)->meta;
 
             // unbound, runtime-determined value signals an argument
-            if (m.type()->kind() == Kind::RUNTIME && m.asRuntime() == nullptr)
+            if (m && m.type()->kind() == Kind::RUNTIME && m.asRuntime() == nullptr)
                 args.push(((RuntimeType*)m.type())->child()); // erase runtime attribute
         }
         
@@ -221,38 +272,28 @@ namespace basil {
                 err(PHASE_TYPE, _type->line(), _type->column(),
                     "Could not resolve return type - expected '", TYPE, "' ",
                     "but found '", typeval.type(), "'.");
+                popFrame(frame);
                 return Meta();
             }
             rettype = typeval.asType();
         }
         else {
-            Meta m = _body->eval(_local);
+            Meta m = _body->eval(frame);
             if (!m) {
                 err(PHASE_TYPE, _body->line(), _body->column(),
                     "Could not infer return type from function body.");
+                popFrame(frame);
                 return Meta();
             }
             rettype = m.type();
         }
+        popFrame(frame);
 
         if (rettype->kind() == Kind::RUNTIME)
             rettype = ((RuntimeType*)rettype)->child();
 
-        Env* valenv = _local->fork();
-        valenv->setParent(env);
-        vector<u32> valargs;
-        
-        for (u32 i = 0; i < valenv->entries().size(); i ++) {
-            const Meta& m = valenv->entry(i)->meta;
-
-            // unbound, runtime-determined value signals an argument
-            if (m.type()->kind() != Kind::RUNTIME || m.asRuntime()) break;
-            
-            valargs.push(i);
-        }
-
-        return Meta(find<FunctionType>(args, rettype), 
-            new MetaFunction(_body, valargs, valenv));
+        return Meta(find<FunctionType>(args, rettype), new (captured.size()) 
+            MetaFunction(_body, _layout, scope, captured.begin(), captured.size()));
     }
 
     // Call
@@ -262,11 +303,6 @@ namespace basil {
         //
     }
 
-    Call::~Call() {
-        delete _func;
-        for (Node* n : _args) delete n;
-    }
-
     Meta Call::eval(Env* env) {
         Meta m = _func->eval(env);
         if (!m.isFunction()) {
@@ -284,17 +320,22 @@ namespace basil {
             return Meta();
         }
 
+        // every call gets its own frame, so a function can be reentered - 
+        // calls made while evaluating the arguments push theirs above it
+        Env* frame = pushFrame(f.layout(), f.scope(), f.captures(), f.ncaptures());
         for (u32 i = 0; i < ft->args().size(); i ++) {
             Meta m = _args[i]->eval(env);
             if (!m.type()->implicitly(ft->args()[i])) {
                 err(PHASE_TYPE, _args[i]->line(), _args[i]->column(),
                     "Incorrect argument type: expected '",
                     ft->args()[i], "', but found '", m.type(), "'.");
+                popFrame(frame);
                 return Meta();
             }
-            f.arg(i)->meta = m;
+            frame->entry(i)->meta = m;
         }
-        Meta result = f.function()->eval(f.local());
+        Meta result = f.function()->eval(frame);
+        popFrame(frame);
 
         return result;
     }
@@ -306,10 +347,6 @@ namespace basil {
         //
     }
 
-    Add::~Add() {
-        for (Node* n : _params) delete n;
-    }
-
     Meta Add::eval(Env* env) {
         Meta m = _params[0]->eval(env);
         for (u32 i = 1; i < _params.size(); i ++)
@@ -324,10 +361,6 @@ namespace basil {
         //
     }
 
-    Subtract::~Subtract() {
-        for (Node* n : _params) delete n;
-    }
-
     Meta Subtract::eval(Env* env) {
         Meta m = _params[0]->eval(env);
         if (_params.size() == 1) // negate
@@ -346,10 +379,6 @@ namespace basil {
         //
     }
 
-    Multiply::~Multiply() {
-        for (Node* n : _params) delete n;
-    }
-
     Meta Multiply::eval(Env* env) {
         Meta m = _params[0]->eval(env);
         for (u32 i = 1; i < _params.size(); i ++)
@@ -364,10 +393,6 @@ namespace basil {
         //
     }
 
-    Divide::~Divide() {
-        for (Node* n : _params) delete n;
-    }
-
     Meta Divide::eval(Env* env) {
         Meta m = _params[0]->eval(env);
         if (_params.size() == 1) // negate
@@ -7,11 +7,28 @@
 #include "errors.h"
 
 namespace basil {
+    // values a function captures are read from wherever they live in the
+    // scope it's created in, which may mean capturing them there too
+    static vector<Node*> captures(Env* env, const vector<i64>& names, const BlockTerm* term) {
+        vector<Node*> nodes;
+        for (i64 name : names)
+            nodes.push(new Variable(name, locate(env, name), term->line(), term->column()));
+        return nodes;
+    }
+
+    // an operation on constants is evaluated right away, and replaced with
+    // its result - unless it doesn't produce one, in which case it's left
+    // for evaluation to deal with as before
+    static Node* fold(Env* env, Node* op, const vector<Node*>& params) {
+        for (Node* n : params) if (!n || !n->isConstant()) return op;
+        Meta m = op->eval(env);
+        if (!m) return op;
+        return new Constant(m, op->line(), op->column());
+    }
+
     Node* define(Env* env, Node* func, const BlockTerm* term) {
-        delete func;
-        
         u32 i = 1;
-        vector<ustring> names;
+        vector<i64> names;
         BlockTerm* fnargs = nullptr;
         while (i < term->terms().size()) {
             Meta q = term->terms()[i]->quote();
@@ -25,9 +42,9 @@ namespace basil {
 
             // stop declaring new variables when we find a value or
             // an existing variable
-            if (!q.isSymbol() || env->lookup(findSymbol(q.asSymbol())))
+            if (!q.isSymbol() || env->lookup(q.asSymbol()))
                 break;
-            names.push(findSymbol(q.asSymbol()));
+            names.push(q.asSymbol());
             ++ i;
         }
 
@@ -38,15 +55,20 @@ namespace basil {
         }
 
         if (fnargs) {
+            pushScope();
             Node* args = fnargs->eval(env);
 
             vector<Node*> bodyvals;
             for (; i < term->terms().size(); i ++)
                 bodyvals.push(term->terms()[i]->eval(env));
             Node* body = new Do(bodyvals);
+            Scope scope = popScope();
 
+            for (i64 name : names) bindLocal(name);
             return new Define(names, 
-                new Lambda({ args }, body, term->line(), term->column()),
+                new Lambda({ args }, scope.names, 
+                    captures(env, scope.captures, term), body, 
+                    term->line(), term->column()),
                 term->line(), term->column());
         }
 
@@ -62,6 +84,7 @@ namespace basil {
         }
 
         Node* init = term->terms()[i]->eval(env);
+        for (i64 name : names) bindLocal(name);
         return new Define(names, init, term->line(), term->column());
     }
 
@@ -70,12 +93,11 @@ namespace basil {
         if (!m.isType()) {
             err(PHASE_TYPE, term->terms()[0]->line(), term->terms()[0]->column(),
                 "Could not resolve type in declaration.");
-            delete type;
             return nullptr;
         }
 
         u32 i = 1;
-        vector<ustring> names;
+        vector<i64> names;
         BlockTerm* fnargs = nullptr;
         while (i < term->terms().size()) {
             Meta q = term->terms()[i]->quote();
@@ -89,9 +111,9 @@ namespace basil {
 
             // stop declaring new variables when we find a value or
             // an existing variable
-            if (!q.isSymbol() || env->lookup(findSymbol(q.asSymbol())))
+            if (!q.isSymbol() || env->lookup(q.asSymbol()))
                 break;
-            names.push(findSymbol(q.asSymbol()));
+            names.push(q.asSymbol());
             ++ i;
         }
 
@@ -102,32 +124,35 @@ namespace basil {
         }
 
         if (fnargs) {
+            pushScope();
             Node* args = fnargs->eval(env);
 
             vector<Node*> bodyvals;
             for (; i < term->terms().size(); i ++)
                 bodyvals.push(term->terms()[i]->eval(env));
             Node* body = new Do(bodyvals);
+            Scope scope = popScope();
 
+            for (i64 name : names) bindLocal(name);
             return new Define(names, 
-                new Lambda(type, { args }, body, term->line(), term->column()),
+                new Lambda(type, { args }, scope.names, 
+                    captures(env, scope.captures, term), body, 
+                    term->line(), term->column()),
                 term->line(), term->column());
         }
 
         if (i < term->terms().size() - 1) {
             err(PHASE_TYPE, term->terms()[i + 1]->line(), term->terms()[i + 1]->column(),
                 "More than one initial value provided in variable declaration.");
-            delete type;
             return nullptr;
         }
 
         Node* init = i < term->terms().size() ? term->terms()[i]->eval(env) : nullptr;
+        for (i64 name : names) bindLocal(name);
         return new Define(type, names, init, term->line(), term->column());
     }
 
     Node* lambda(Env* env, Node* func, const BlockTerm* term) {
-        delete func;
-
         if (term->terms().size() < 3) {
             err(PHASE_TYPE, term->line(), term->column(),
                 "Not enough arguments in lambda expression: expected at least 3, ",
@@ -142,14 +167,18 @@ namespace basil {
             return nullptr;
         }
 
+        // arguments and locals are bound in the lambda's own scope
+        pushScope();
         Node* args = term->terms()[1]->eval(env);
 
         vector<Node*> bodyvals;
         for (u32 i = 2; i < term->terms().size(); i ++)
             bodyvals.push(term->terms()[i]->eval(env));
         Node* body = new Do(bodyvals);
+        Scope scope = popScope();
 
-        return new Lambda({ args }, body, term->line(), term->column());
+        return new Lambda({ args }, scope.names, 
+            captures(env, scope.captures, term), body, term->line(), term->column());
     }
 
     Node* call(Env* env, Node* func, const BlockTerm* term) {
@@ -160,14 +189,10 @@ namespace basil {
     }
 
     Node* quote(Env* env, Node* func, const BlockTerm* term) {
-        delete func;
-
         return new Quote(term->terms()[1], term->line(), term->column());
     }
 
     Node* doBlock(Env* env, Node* func, const BlockTerm* term) {
-        delete func;
-
         vector<Node*> body;
         for (u32 i = 1; i < term->terms().size(); i ++) {
             body.push(term->terms()[i]->eval(env));
@@ -183,8 +208,6 @@ namespace basil {
     }
 
     Node* add(Env* env, Node* func, const BlockTerm* term) {
-        delete func;
-
         vector<Node*> params;
         for (u32 i = 1; i < term->terms().size(); i ++)
             params.push(term->terms()[i]->eval(env));
@@ -195,11 +218,10 @@ namespace basil {
             return nullptr;
         }
 
-        return new Add(params, term->line(), term->column());
+        return fold(env, new Add(params, term->line(), term->column()), params);
     }
 
     Node* subtract(Env* env, Node* func, const BlockTerm* term) {
-        delete func;
         vector<Node*> params;
         for (u32 i = 1; i < term->terms().size(); i ++)
             params.push(term->terms()[i]->eval(env));
@@ -210,11 +232,10 @@ namespace basil {
             return nullptr;
         }
 
-        return new Subtract(params, term->line(), term->column());
+        return fold(env, new Subtract(params, term->line(), term->column()), params);
     }
 
     Node* multiply(Env* env, Node* func, const BlockTerm* term) {
-        delete func;
         vector<Node*> params;
         for (u32 i = 1; i < term->terms().size(); i ++)
             params.push(term->terms()[i]->eval(env));
@@ -225,11 +246,10 @@ namespace basil {
             return nullptr;
         }
 
-        return new Multiply(params, term->line(), term->column());
+        return fold(env, new Multiply(params, term->line(), term->column()), params);
     }
 
     Node* divide(Env* env, Node* func, const BlockTerm* term) {
-        delete func;
         vector<Node*> params;
         for (u32 i = 1; i < term->terms().size(); i ++)
             params.push(term->terms()[i]->eval(env));
@@ -240,6 +260,14 @@ namespace basil {
             return nullptr;
         }
 
-        return new Divide(params, term->line(), term->column());
+        Node* op = new Divide(params, term->line(), term->column());
+
+        // integer division by a constant zero is left for evaluation
+        for (u32 i = params.size() > 1 ? 1 : 0; i < params.size(); i ++) {
+            if (!params[i] || !params[i]->isConstant()) continue;
+            Meta m = params[i]->eval(env);
+            if (m.isInt() && m.asInt() == 0) return op;
+        }
+        return fold(env, op, params);
     }
 }
\ No newline at end of file
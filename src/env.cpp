@@ -1,11 +1,25 @@
 #include "env.h"
+#include <cstdlib>
 
 namespace basil {
     Env::Env():
-        _parent(nullptr) {
+        _table(new Table()), _layout(_table), _slots(nullptr), _nslots(0),
+        _captures(nullptr), _ncaptures(0), _parent(nullptr) {
         //
     }
 
+    Env::Env(const Env* layout, Entry* slots, Env* parent, 
+        const Meta* captures, u32 ncaptures):
+        _table(nullptr), _layout(layout->_layout), _slots(slots), 
+        _nslots(layout->size()), _captures(captures), _ncaptures(ncaptures), 
+        _parent(parent) {
+        //
+    }
+
+    Env::~Env() {
+        if (_table) delete _table;
+    }
+
     void Env::setParent(Env* parent) {
         _parent = parent;
     }
@@ -14,54 +28,173 @@ namespace basil {
         return _parent;
     }
 
+    u32 Env::size() const {
+        return _table ? _table->entries.size() : _nslots;
+    }
+
+    i64 Env::name(u32 i) const {
+        return _layout->names[i];
+    }
+
+    i64 Env::slot(i64 name) const {
+        auto it = _layout->index.find(name);
+        return it == _layout->index.end() ? -1 : i64(it->second);
+    }
+
     Entry* Env::entry(u32 i) {
-        return &_entryOrder[i]->second;
+        return _table ? &_table->entries[i] : _slots + i;
     }
 
     const Entry* Env::entry(u32 i) const {
-        return &_entryOrder[i]->second;
+        return _table ? &_table->entries[i] : _slots + i;
     }
 
-    Entry* Env::lookup(const ustring& name) {
-        auto it = _entries.find(name);
-        if (it != _entries.end()) return &it->second;
+    // a frame's locals aren't bound until their definitions are reached
+    Entry* Env::lookup(i64 name) {
+        i64 i = slot(name);
+        if (i >= 0 && (_table || _slots[i].meta)) return entry(i);
         else if (_parent) return _parent->lookup(name);
         else return nullptr;
     }
 
-    const Entry* Env::lookup(const ustring& name) const {
-        auto it = _entries.find(name);
-        if (it != _entries.end()) return &it->second;
+    const Entry* Env::lookup(i64 name) const {
+        i64 i = slot(name);
+        if (i >= 0 && (_table || _slots[i].meta)) return entry(i);
         else if (_parent) return _parent->lookup(name);
         else return nullptr;
     }
 
-    void Env::enter(const ustring& name, const Meta& meta) {
-        auto it = _entries.find(name);
-        if (it != _entries.end()) it->second.meta = meta;
-        else {
-            _entries.put(name, { meta });
-            auto nit = _entries.find(name);
-            _entryOrder.push(&*nit);
+    // every name a function binds was recorded in its layout while it was
+    // lowered, so a frame always has a slot for it
+    void Env::enter(i64 name, const Meta& meta) {
+        i64 i = slot(name);
+        if (i >= 0) entry(i)->meta = meta;
+        else if (_table) {
+            _table->index.put(name, _table->entries.size());
+            _table->entries.push({ meta });
+            _table->names.push(name);
         }
     }
 
-    Env* Env::fork() const {
-        Env* result = new Env();
-        result->setParent(_parent);
+    bool Env::isFrame() const {
+        return !_table;
+    }
+
+    const Meta* Env::capture(u32 i) const {
+        return i < _ncaptures ? _captures + i : nullptr;
+    }
+
+    static const u64 FRAME_BLOCK_SIZE = 262144;
 
-        for (auto e : _entryOrder) {
-            result->_entries.put(e->first, e->second);
-            result->_entryOrder.push(&*result->_entries.find(e->first));
+    // the stack position to go back to when a frame is popped
+    struct FrameMark {
+        u8 *top, *end;
+        u32 next;
+    };
+
+    // blocks are kept for reuse once they've been allocated
+    struct FrameStack {
+        vector<pair<u8*, u64>> blocks;
+        u32 next = 0;
+        u8 *top = nullptr, *end = nullptr;
+
+        ~FrameStack() {
+            for (const pair<u8*, u64>& block : blocks) free(block.first);
         }
-        return result;
+    };
+
+    static thread_local FrameStack frames;
+
+    Env* pushFrame(const Env* layout, Env* parent, const Meta* captures, u32 ncaptures) {
+        u32 n = layout->size();
+        u64 size = sizeof(FrameMark) + sizeof(Env) + n * sizeof(Entry);
+        size = (size + 15) & ~u64(15);
+
+        FrameMark mark = { frames.top, frames.end, frames.next };
+        if (size > u64(frames.end - frames.top)) {
+            if (frames.next == frames.blocks.size()) 
+                frames.blocks.push({ nullptr, 0 });
+            pair<u8*, u64>& block = frames.blocks[frames.next];
+            if (block.second < size) {
+                free(block.first);
+                block.second = size > FRAME_BLOCK_SIZE ? size : FRAME_BLOCK_SIZE;
+                block.first = (u8*)malloc(block.second);
+            }
+            frames.top = block.first, frames.end = block.first + block.second;
+            ++ frames.next;
+        }
+
+        u8* p = frames.top;
+        frames.top += size;
+        *(FrameMark*)p = mark;
+        Entry* slots = (Entry*)(p + sizeof(FrameMark) + sizeof(Env));
+        for (u32 i = 0; i < n; i ++) new (slots + i) Entry(*layout->entry(i));
+        return new (p + sizeof(FrameMark)) Env(layout, slots, parent, captures, ncaptures);
+    }
+
+    void popFrame(Env* frame) {
+        for (u32 i = 0; i < frame->_nslots; i ++) frame->_slots[i].~Entry();
+        frame->~Env();
+        FrameMark mark = *(FrameMark*)((u8*)frame - sizeof(FrameMark));
+        frames.top = mark.top, frames.end = mark.end, frames.next = mark.next;
+    }
+
+    static thread_local vector<Scope> scopes;
+
+    void pushScope() {
+        scopes.push({});
+    }
+
+    Scope popScope() {
+        Scope scope = scopes.back();
+        scopes.pop();
+        return scope;
+    }
+
+    void bindLocal(i64 name) {
+        if (!scopes.size()) return; // not in a function
+        for (i64 n : scopes.back().names) if (n == name) return;
+        scopes.back().names.push(name);
+    }
+
+    bool isLocal(i64 name) {
+        for (const Scope& scope : scopes)
+            for (i64 n : scope.names) if (n == name) return true;
+        return false;
     }
 
-    map<ustring, Entry>& Env::entries() {
-        return _entries;
+    static i64 indexOf(const vector<i64>& names, i64 name) {
+        for (u32 i = 0; i < names.size(); ++ i) if (names[i] == name) return i;
+        return -1;
     }
 
-    const map<ustring, Entry>& Env::entries() const {
-        return _entries;
+    Address locate(const Env* env, i64 name) {
+        if (scopes.size()) {
+            Scope& inner = scopes.back();
+            i64 i = indexOf(inner.names, name);
+            if (i >= 0) return { Address::SLOT, 0, u32(i) };
+            i = indexOf(inner.captures, name);
+            if (i >= 0) return { Address::CAPTURE, 0, u32(i) };
+
+            // a local of an enclosing function is copied in when this one
+            // is created - the enclosing function captures it in turn when 
+            // its own scope is popped, if it has to
+            for (u32 j = scopes.size() - 1; j > 0; -- j) {
+                const Scope& outer = scopes[j - 1];
+                if (indexOf(outer.names, name) >= 0 || indexOf(outer.captures, name) >= 0) {
+                    inner.captures.push(name);
+                    return { Address::CAPTURE, 0, inner.captures.size() - 1 };
+                }
+            }
+        }
+
+        // past the functions being lowered, it's the environment chain 
+        // they'll be evaluated in - one step up from any frame
+        u32 depth = scopes.size() ? 1 : 0;
+        for (; env; env = env->parent(), ++ depth) {
+            i64 i = env->slot(name);
+            if (i >= 0) return { Address::SLOT, depth, u32(i) };
+        }
+        return { Address::UNBOUND, 0, 0 };
     }
-}
\ No newline at end of file
+}
@@ -16,11 +16,12 @@ namespace basil {
         }
     }   
 
-    static vector<Error> errors;
-    static set<ustring> messages;
+    // each thread reports into its own list
+    static thread_local vector<Error> errors;
+    static thread_local set<ustring> messages;
 
-    static vector<vector<Error>> errorFrames;
-    static vector<set<ustring>> frameMessages;
+    static thread_local vector<vector<Error>> errorFrames;
+    static thread_local vector<set<ustring>> frameMessages;
 
     void catchErrors() {
         errorFrames.push({});
@@ -40,6 +41,17 @@ namespace basil {
         frameMessages.pop();
     }
 
+    vector<Error> takeErrors() {
+        vector<Error>& es = errorFrames.size() 
+            ? errorFrames.back() : errors;
+        set<ustring>& ms = frameMessages.size() 
+            ? frameMessages.back() : messages;
+        vector<Error> taken = es;
+        es.clear();
+        ms = set<ustring>();
+        return taken;
+    }
+
     void prefixPhase(buffer& b, Phase phase) {
         switch (phase) {
             case PHASE_LEX:
@@ -56,13 +68,13 @@ namespace basil {
         }
     }
 
-    static Source* _src;
+    static thread_local const Source* _src;
 
-    void useSource(Source* src) {
+    void useSource(const Source* src) {
         _src = src;
     }
 
-    Source* currentSource() {
+    const Source* currentSource() {
         return _src;
     }
 
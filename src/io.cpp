@@ -1,5 +1,10 @@
 #include "io.h"
 #include "str.h"
+#include "num.h"
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
 
 bool exists(const char* path) {
     FILE* f = fopen(path, "r");
@@ -7,46 +12,117 @@ bool exists(const char* path) {
     else return fclose(f), true;
 }
 
-file::file(const char* fname, const char* flags): 
-    file(fopen(fname, flags)) {
+void stream::write(const u8* data, u32 size) {
+    for (u32 i = 0; i < size; ++ i) write(data[i]);
+}
+
+u32 stream::read(u8* data, u32 size) {
+    u32 i = 0;
+    while (i < size && *this) data[i ++] = read();
+    return i;
+}
+
+void stream::flush() {
     //
 }
 
-file::file(FILE* f_in): f(f_in), done(false) {
+file::file(const char* fname, const char* flags, u32 kb): 
+    file(fopen(fname, flags), kb) {
     //
 }
 
+file::file(FILE* f_in, u32 kb): f(f_in), fd(f ? fileno(f) : -1), 
+    _bufsize(kb ? kb * 1024 : 1024), _rcapacity(_bufsize), _wend(0),
+    _rstart(0), _rend(0), done(false) {
+    rbuf = new u8[_rcapacity];
+    wbuf = new u8[_bufsize];
+}
+
 file::~file() {
-    fclose(f);
+    flush();
+    delete[] rbuf;
+    delete[] wbuf;
+    if (f) fclose(f);
+}
+
+bool file::refill() const {
+    if (done || fd < 0) return false;
+    ssize_t n;
+    do n = ::read(fd, rbuf, _rcapacity);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0) return done = true, false;
+    _rstart = 0, _rend = n;
+    return true;
 }
 
 void file::write(u8 c) {
-    fputc(c, f);
+    if (_wend == _bufsize) flush();
+    wbuf[_wend ++] = c;
+}
+
+void file::write(const u8* data, u32 size) {
+    if (_wend + size > _bufsize) flush();
+    if (size >= _bufsize) { // too big to be worth buffering
+        while (size && fd >= 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            data += n, size -= n;
+        }
+        return;
+    }
+    memcpy(wbuf + _wend, data, size);
+    _wend += size;
 }
 
 u8 file::read() {
-    if (done) return '\0';
-    int i = fgetc(f);
-    if (i == EOF) done = true;
-    return i;
+    if (_rstart == _rend && !refill()) return '\0';
+    return rbuf[_rstart ++];
+}
+
+u32 file::read(u8* data, u32 size) {
+    u32 total = 0;
+    while (total < size && (_rstart != _rend || refill())) {
+        u32 n = _rend - _rstart;
+        if (n > size - total) n = size - total;
+        memcpy(data + total, rbuf + _rstart, n);
+        _rstart += n, total += n;
+    }
+    return total;
 }
 
 u8 file::peek() const {
-    if (done) return '\0';
-    int i = fgetc(f);
-    ungetc(i, f);
-    if (i == EOF) return '\0';
-    return i;
+    if (_rstart == _rend && !refill()) return '\0';
+    return rbuf[_rstart];
 }
 
 void file::unget(u8 c) {
-    ungetc(c, f);
+    if (_rstart == 0) { // make room at the front of the read buffer
+        if (_rend == _rcapacity) {
+            u8* old = rbuf;
+            rbuf = new u8[_rcapacity *= 2];
+            memcpy(rbuf, old, _rend);
+            delete[] old;
+        }
+        memmove(rbuf + 1, rbuf, _rend);
+        ++ _rstart, ++ _rend;
+    }
+    rbuf[-- _rstart] = c;
+}
+
+void file::flush() {
+    u32 i = 0;
+    while (i < _wend && fd >= 0) {
+        ssize_t n = ::write(fd, wbuf + i, _wend - i);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        i += n;
+    }
+    _wend = 0;
 }
 
 file::operator bool() const {
-    int i = fgetc(f);
-    ungetc(i, f);
-    return i != EOF;
+    return _rstart != _rend || refill();
 }
 
 void buffer::init(u32 size) {
@@ -103,6 +179,15 @@ void buffer::write(u8 c) {
     _end = (_end + 1) & (_capacity - 1);
 }
 
+void buffer::write(const u8* src, u32 size) {
+    while (this->size() + size + 1 >= _capacity) grow();
+    u32 first = _capacity - _end;
+    if (first > size) first = size;
+    memcpy(data + _end, src, first);
+    memcpy(data, src + first, size - first);
+    _end = (_end + size) & (_capacity - 1);
+}
+
 u8 buffer::read() {
     if (_start == _end) return '\0';
     u8 c = data[_start];
@@ -110,6 +195,16 @@ u8 buffer::read() {
     return c;
 }
 
+u32 buffer::read(u8* dst, u32 size) {
+    if (size > this->size()) size = this->size();
+    u32 first = _capacity - _start;
+    if (first > size) first = size;
+    memcpy(dst, data + _start, first);
+    memcpy(dst + first, data, size - first);
+    _start = (_start + size) & (_capacity - 1);
+    return size;
+}
+
 u8 buffer::peek() const {
     if (_start == _end) return '\0';
     return data[_start];
@@ -154,42 +249,24 @@ file _stdin_file(stdin), _stdout_file(stdout);
 
 stream &_stdin = _stdin_file, &_stdout = _stdout_file;
 
-static u32 precision = 5;
-
-void setprecision(u32 p) {
-    precision = p;
-}
-
 static void print_unsigned(stream& io, u64 n) {
-    u64 m = n, p = 1;
-    while (m / 10) m /= 10, p *= 10;
-    while (p) io.write('0' + (n / p % 10)), p /= 10;
+    u8 buf[NUMBER_BUFFER_SIZE];
+    io.write(buf, format_unsigned({ sizeof(buf), buf }, n));
 }
 
 static void print_signed(stream& io, i64 n) {
-    if (n < 0) io.write('-'), n = -n;
-    print_unsigned(io, n);
+    u8 buf[NUMBER_BUFFER_SIZE];
+    io.write(buf, format_signed({ sizeof(buf), buf }, n));
+}
+
+static void print_rational(stream& io, float f) {
+    u8 buf[NUMBER_BUFFER_SIZE];
+    io.write(buf, format_float({ sizeof(buf), buf }, f));
 }
 
 static void print_rational(stream& io, double d) {
-    if (d < 0) io.write('-'), d = -d;
-    print_unsigned(io, u64(d));
-    io.write('.');
-    double r = d - u64(d);
-    u32 p = precision, zeroes = 0;
-    bool isZero = r == 0;
-    while (r && p) {
-        r *= 10;
-        if (u8(r)) {
-            isZero = false;
-            while (zeroes) io.write('0'), -- zeroes;
-            io.write('0' + u8(r));
-        }
-        else ++ zeroes;
-        r -= u8(r);
-        -- p;
-    }
-    if (isZero) io.write('0');
+    u8 buf[NUMBER_BUFFER_SIZE];
+    io.write(buf, format_float({ sizeof(buf), buf }, d));
 }
 
 void write(stream& io, u8 c) {
@@ -241,15 +318,19 @@ void write(stream& io, bool b) {
 }
 
 void write(stream& io, const u8* s) {
-    while (*s) io.write(*(s ++));
+    io.write(s, strlen((const char*)s));
 }
 
 void write(stream& io, const char* s) {
-    while (*s) io.write(*(s ++));
+    io.write((const u8*)s, strlen(s));
 }
 
 void write(stream& io, const buffer& b) {
-    for (u8 c : b) io.write(c);
+    if (b._start <= b._end) io.write(b.data + b._start, b._end - b._start);
+    else {
+        io.write(b.data + b._start, b._capacity - b._start);
+        io.write(b.data, b._end);
+    }
 }
 
 bool isspace(u8 c) {
@@ -282,21 +363,14 @@ static i64 read_signed(stream& io) {
 
 static double read_float(stream& io) {
     while (isspace(io.peek())) io.read(); // consume leading spaces
-    buffer b;
-    while (io.peek() && !isspace(io.peek()) && io.peek() != '.') {
-        b.write(io.read());
-    } 
-    if (io.peek() != '.') return read_unsigned((stream&)b);
-    else io.read();
-    u64 i;
-    read(b, i);
-    double pow = 0.1;
-    double result = i;
+    char buf[64];
+    u32 i = 0;
     while (io.peek() && !isspace(io.peek())) {
-        result += (io.read() - '0') * pow;
-        pow *= 0.1;
+        u8 c = io.read();
+        if (i < sizeof(buf) - 1) buf[i ++] = c;
     }
-    return result;
+    buf[i] = '\0';
+    return strtod(buf, nullptr); // correctly rounded, unlike summing digits
 }
 
 void read(stream& io, u8& c) {
@@ -2,26 +2,49 @@
 #include "source.h"
 #include "vec.h"
 #include "errors.h"
+#include "str.h"
+#include "meta.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace basil {
-    static const Token NONE{ "", T_NONE, 0, 0 };
+    static const Token NONE{ T_NONE, 0, 0 };
 
     Token::operator bool() const {
         return id != T_NONE;
     }
     
-    TokenView::TokenView(vector<Token>& cache):
-        _cache(cache), index(0) {
+    TokenView::TokenView(const Source::View& source):
+        _source(source), index(0), _cursor(source) {
         //
     }
 
-    const Token& TokenView::peek() const {
-        if (index >= _cache.size()) return NONE;
+    bool TokenView::fill() {
+        if (index < _cache.size()) return true;
+        if (_cache.size() > 1) {
+            Token last = _cache.back();
+            _cache.clear();
+            _cache.push(last);
+            index = 1;
+        }
+        while (_source.peek()) {
+            if (Token t = lex(_source)) {
+                _cache.push(t);
+                return true;
+            }
+            if (countErrors()) return false; // stop at the first bad token
+        }
+        return false;
+    }
+
+    const Token& TokenView::peek() {
+        if (!fill()) return NONE;
         else return _cache[index];
     }
 
     const Token& TokenView::read() {
-        if (index >= _cache.size()) return NONE;
+        if (!fill()) return NONE;
         else return _cache[index ++];
     }
 
@@ -29,57 +52,219 @@ namespace basil {
         if (index > 0) index --;
     }
 
+    // the end-of-input token sits just past the last character
+    u32 TokenView::line(const Token& t) const {
+        _cursor.seek(t ? t.offset : _cursor.source()->size());
+        return _cursor.line();
+    }
+
+    u32 TokenView::column(const Token& t) const {
+        _cursor.seek(t ? t.offset : _cursor.source()->size());
+        return _cursor.column();
+    }
+
+    const_slice<u8> TokenView::text(const Token& t) const {
+        return _cursor.source()->span(t.offset, t.length);
+    }
+
     static bool isdelim(uchar c) {
         return isspace(c) || c == '(' || c == ')' || c == '[' || c == ']';
     }
 
-    Token lex(Source::View& view) {
-        Token result = NONE;
-        if (view.peek() == '\0') {
-            return NONE;
+    constexpr u8
+        C_DIGIT = 1,
+        C_STRING = 2,   // may appear unescaped in a string
+        C_HIGH = 4;     // part of a multibyte character
+
+    // character classes for each byte, so ASCII text never has to go 
+    // through the Unicode predicates
+    static struct ClassTable {
+        u8 classes[256];
+
+        ClassTable() {
+            for (u32 i = 0; i < 256; ++ i) {
+                u8& c = classes[i];
+                c = 0;
+                if (i != '\n' && i != '\0' && i != '"' && i != '\\') c |= C_STRING;
+                if (i >= 128) {
+                    c |= C_HIGH;
+                    continue;
+                }
+                if (isdigit(uchar(i))) c |= C_DIGIT;
+            }
         }
-        else if (view.peek() == '#') { // consume comment
-            view.read();
-            while (view.peek() != '\n') view.read();
+    } CLASSES;
+
+    static const u8* CLASS = CLASSES.classes;
+
+    static bool unescape(uchar c, uchar& out) {
+        switch (c[0]) {
+            case '"': out = '"'; return true;
+            case '\'': out = '\''; return true;
+            case '\\': out = '\\'; return true;
+            case 'n': out = '\n'; return true;
+            case 't': out = '\t'; return true;
+            case 'r': out = '\r'; return true;
+            case '0': out = '\0'; return true;
+            default: return false;
+        }
+    }
+
+    // decoded text of the identifier or escaped string being lexed
+    static thread_local ustring scratch;
+
+    static const double EXACT_POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    struct Digits {
+        u64 mantissa = 0;
+        u32 digits = 0;
+        i32 exponent = 0;
+        bool overflow = false, inexact = false;
+
+        // keeps the first 19 significant digits, tracking the scale of
+        // anything past them
+        void add(u32 d, bool fraction) {
+            if (!fraction && mantissa > (u64(INT64_MAX) - d) / 10) overflow = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + d;
+                if (mantissa) ++ digits;
+                if (fraction) -- exponent;
+            }
+            else {
+                if (!fraction) ++ exponent;
+                inexact |= d != 0;
+            }
         }
-        else if (isspace(view.peek())) {
-            while (isspace(view.peek())) view.read();
+    };
+
+    // ASCII digits are scanned in bulk; a literal never crosses a line, so 
+    // the run is always contiguous in the source
+    static void scanDigits(Source::View& view, Digits& n, bool fraction) {
+        while (true) {
+            u32 start = view.offset();
+            if (u32 length = view.skip(CLASS, C_DIGIT)) {
+                const_slice<u8> text = view.source()->span(start, length);
+                for (u32 i = 0; i < length; ++ i) n.add(text[i] - '0', fraction);
+            }
+            else if (CLASS[view.peekByte()] & C_HIGH && isdigit(view.peek()))
+                n.add(digitvalue(view.read()), fraction);
+            else break;
         }
-        else if (view.peek() == ':') {
-            result.id = T_QUOTE;
-            result.line = view.line(), result.column = view.column();
-            result.name = ":";
-            view.read();
+    }
+
+    // Scans an integer or float literal, computing its value as we go. 
+    // Integers that don't fit in an i64 come back negative. Floats are 
+    // computed exactly when the digits fit in a double's mantissa and the 
+    // power of ten is exact; otherwise we fall back to strtod on the 
+    // literal's text, which is correctly rounded.
+    static bool lexNumber(Source::View& view, Token& result) {
+        Source::View start = view;
+        Digits n;
+        scanDigits(view, n, false);
+        if (view.peekByte() != '.') {
+            result.intval = n.overflow ? -1 : i64(n.mantissa);
+            return true;
         }
-        else if (view.peek() == '(') {
-            result.id = T_LPAREN;
-            result.line = view.line(), result.column = view.column();
-            result.name = "(";
-            view.read();
+
+        result.id = T_FLOAT;
+        view.read();
+        scanDigits(view, n, true);
+
+        if (!n.inexact && n.mantissa <= (1ull << 53) 
+            && n.exponent >= -22 && n.exponent <= 22) {
+            result.floatval = n.exponent < 0 
+                ? double(n.mantissa) / EXACT_POW10[-n.exponent]
+                : double(n.mantissa) * EXACT_POW10[n.exponent];
+            return true;
         }
-        else if (view.peek() == ')') {
-            result.id = T_RPAREN;
-            result.line = view.line(), result.column = view.column();
-            result.name = ")";
-            view.read();
+
+        string text;
+        while (start.offset() < view.offset()) {
+            uchar c = start.read();
+            text += c == '.' ? '.' : char('0' + digitvalue(c));
         }
-        else if (view.peek() == '[') {
-            result.id = T_LBRACK;
-            result.line = view.line(), result.column = view.column();
-            result.name = "[";
-            view.read();
+        result.floatval = strtod((const char*)text.raw(), nullptr);
+        return true;
+    }
+
+    // recently seen short identifiers, so repeated names skip decoding and 
+    // the symbol table lookup
+    constexpr u32 IDENT_CACHE_SIZE = 1024, IDENT_CACHE_LENGTH = 16;
+
+    struct IdentEntry {
+        u8 text[IDENT_CACHE_LENGTH];
+        u32 length;
+        i64 id;
+    };
+
+    static thread_local IdentEntry identCache[IDENT_CACHE_SIZE];
+
+    static i64 intern(const const_slice<u8>& text) {
+        IdentEntry& e = identCache[raw_hash(&text[0], text.size()) & (IDENT_CACHE_SIZE - 1)];
+        if (e.length == text.size() && !memcmp(e.text, &text[0], e.length)) return e.id;
+
+        scratch.clear();
+        for (u32 i = 0; i < text.size(); ) {
+            if (text[i] < 128) scratch += uchar(text[i ++]);
+            else {
+                uchar c((const char*)&text[i]);
+                scratch += c, i += c.size();
+            }
+        }
+        i64 id = findSymbol(scratch);
+        if (text.size() <= IDENT_CACHE_LENGTH) {
+            memcpy(e.text, &text[0], text.size());
+            e.length = text.size(), e.id = id;
         }
-        else if (view.peek() == ']') {
-            result.id = T_RBRACK;
-            result.line = view.line(), result.column = view.column();
-            result.name = "]";
+        return id;
+    }
+
+    static u32 punctuation(u8 b) {
+        switch (b) {
+            case ':': return T_QUOTE;
+            case '(': return T_LPAREN;
+            case ')': return T_RPAREN;
+            case '[': return T_LBRACK;
+            case ']': return T_RBRACK;
+            default: return T_NONE;
+        }
+    }
+
+    Token lex(Source::View& view) {
+        u8 b;
+        while (true) { // skip whitespace and comments
+            view.skipSpace();
+            b = view.peekByte();
+            if (b == '#') {
+                do view.read(), view.skipToStructural(false);
+                while ((b = view.peekByte()) != '\n' && b != '\0');
+            }
+            else if (CLASS[b] & C_HIGH && isspace(view.peek())) view.read();
+            else break;
+        }
+
+        Token result = NONE;
+        result.offset = view.offset();
+        uchar c = CLASS[b] & C_HIGH ? view.peek() : uchar(b);
+        if (b == '\0') {
+            return NONE;
+        }
+        else if (u32 id = punctuation(b)) {
+            result.id = id;
             view.read();
         }
-        else if (view.peek() == '"') {
+        else if (b == '"') {
             result.id = T_STRING;
-            result.line = view.line(), result.column = view.column();
+            result.symbol = -1;
             view.read();
-            while (view.peek() != '"') {
+            Source::View body = view;
+            bool escaped = false;
+            while (true) {
+                if (!escaped) view.skip(CLASS, C_STRING);
+                if (view.peekByte() == '"') break;
                 if (view.peek() == '\n') {
                     err(PHASE_LEX, view.line(), view.column(),
                         "Line breaks are not permitted within string constants.");
@@ -92,31 +277,32 @@ namespace basil {
                     return NONE;
                 }
                 else if (view.peek() == '\\') {
+                    if (!escaped) { // only escaped strings get a decoded copy
+                        scratch.clear();
+                        while (body.offset() < view.offset()) scratch += body.read();
+                        escaped = true;
+                    }
                     view.read();
-                    switch (view.peek()[0]) {
-                        case '"': result.name += '"'; break;
-                        case '\'': result.name += '\''; break;
-                        case '\\': result.name += '\\'; break;
-                        case 'n': result.name += '\n'; break;
-                        case 't': result.name += '\t'; break;
-                        case 'r': result.name += '\r'; break;
-                        case '0': result.name += '\0'; break;
-                        default: 
-                            err(PHASE_LEX, view.line(), view.column(),
-                                "Unknown escape sequence '\\", view.peek(), "'.");
-                            view.read();
-                            return NONE;
+                    uchar e;
+                    if (!unescape(view.peek(), e)) {
+                        err(PHASE_LEX, view.line(), view.column(),
+                            "Unknown escape sequence '\\", view.peek(), "'.");
+                        view.read();
+                        return NONE;
                     }
+                    scratch += e;
                     view.read();
                 }
-                else result.name += view.read();
+                else if (escaped) scratch += view.read();
+                else view.read();
             }
             view.read();
+            if (escaped) result.symbol = findSymbol(scratch);
         }
-        else if (view.peek() == '\'') {
+        else if (b == '\'') {
             result.id = T_CHAR;
-            result.line = view.line(), result.column = view.column();
             view.read();
+            uchar value;
             if (view.peek() == '\n') {
                 err(PHASE_LEX, view.line(), view.column(),
                     "Line breaks are not permitted within character constants.");
@@ -130,23 +316,16 @@ namespace basil {
             }
             else if (view.peek() == '\\') {
                 view.read();
-                switch (view.peek()[0]) {
-                    case '"': result.name += '"'; break;
-                    case '\'': result.name += '\''; break;
-                    case '\\': result.name += '\\'; break;
-                    case 'n': result.name += '\n'; break;
-                    case 't': result.name += '\t'; break;
-                    case 'r': result.name += '\r'; break;
-                    case '0': result.name += '\0'; break;
-                    default: 
-                        err(PHASE_LEX, view.line(), view.column(),
-                            "Unknown escape sequence '\\", view.peek(), "'.");
-                        view.read();
-                        return NONE;
+                if (!unescape(view.peek(), value)) {
+                    err(PHASE_LEX, view.line(), view.column(),
+                        "Unknown escape sequence '\\", view.peek(), "'.");
+                    view.read();
+                    return NONE;
                 }
                 view.read();
             }
-            else result.name += view.read();
+            else value = view.read();
+            for (u32 i = 0; i < 4; ++ i) result.charval[i] = value[i];
             
             if (view.peek() != '\'') {
                 err(PHASE_LEX, view.line(), view.column(),
@@ -156,40 +335,45 @@ namespace basil {
             }
             else view.read();
         }
-        else if (isdigit(view.peek())) {
+        else if (CLASS[b] & C_DIGIT || (CLASS[b] & C_HIGH && isdigit(c))) {
             result.id = T_INT;
-            result.line = view.line(), result.column = view.column();
-            result.name += view.read();
-            while (isdigit(view.peek())) {
-                result.name += view.read();
-            }
-            if (view.peek() == '.') {
-                result.id = T_FLOAT;
-                result.name += view.read();
-                while (isdigit(view.peek())) {
-                    result.name += view.read();
-                }
-            }
+            Source::View start = view;
+            if (!lexNumber(view, result)) return NONE;
             if (!isdelim(view.peek())) {
                 err(PHASE_LEX, view.line(), view.column(),
                     "Unexpected character '", view.peek(), "' in numeric literal.");
                 view.read();
                 return NONE;
             }
+            if (result.id == T_INT && result.intval < 0) {
+                err(PHASE_LEX, start.line(), start.column(),
+                    "Integer literal is too large.");
+                return NONE;
+            }
+            if (result.id == T_FLOAT && result.floatval == INFINITY) {
+                err(PHASE_LEX, start.line(), start.column(),
+                    "Floating-point literal is too large.");
+                return NONE;
+            }
         }
-        else if (isprint(view.peek())) {
-            if (view.peek() == '_') {
+        else if (isprint(c)) {
+            if (b == '_') {
                 err(PHASE_LEX, view.line(), view.column(),
                     "Identifiers cannot start with '_'.");
                 view.read();
                 return NONE;
             }
             result.id = T_IDENT;
-            result.line = view.line(), result.column = view.column();
-            result.name += view.read();
-            while (!isdelim(view.peek())) {
-                result.name += view.read();
+            view.read();
+            while (true) {
+                view.skipToStructural(true);
+                u8 next = view.peekByte();
+                if (next == '"' || next == '\'' || next == '#') view.read();
+                else if (CLASS[next] & C_HIGH && !isdelim(view.peek())) view.read();
+                else break;
             }
+            result.symbol = intern(view.source()->span(result.offset, 
+                view.offset() - result.offset));
         }
         else {
             err(PHASE_LEX, view.line(), view.column(),
@@ -197,10 +381,80 @@ namespace basil {
             view.read();
             return NONE;
         }
+        result.length = view.offset() - result.offset;
         return result;
     }
+
+    // true if one of the quote, string or comment characters at 'offset' 
+    // begins a token, rather than continuing an identifier; a run of ':' 
+    // quote tokens in front of it doesn't change that
+    static bool startsToken(const Source& src, u32 offset, u32 lineStart, u32 literalEnd) {
+        while (offset > lineStart && src.span(offset - 1, 1)[0] == ':') -- offset;
+        if (offset == lineStart || offset == literalEnd) return true;
+        u32 start = offset - 1; 
+        while (start > lineStart && (src.span(start, 1)[0] & 0xC0) == 0x80) -- start;
+        const_slice<u8> prev = src.span(start, offset - start);
+        return isdelim(prev[0] < 128 ? uchar(prev[0]) : uchar((const char*)&prev[0]));
+    }
+
+    // the last byte before 'offset' on its line that isn't whitespace, or
+    // zero if the line is blank up to there
+    static u8 lastByte(const Source& src, u32 offset, u32 lineStart) {
+        while (offset > lineStart && isspace(uchar(src.span(offset - 1, 1)[0]))) 
+            -- offset;
+        return offset > lineStart ? src.span(offset - 1, 1)[0] : 0;
+    }
+
+    vector<u32> splitForms(const Source& src, u32 target) {
+        vector<u32> splits;
+        Source::View view = src.view();
+        i32 depth = 0;
+        u32 next = target, lineStart = 0, literalEnd = 0, comment = ~0u;
+        bool quoted = false; // a trailing ':' quotes the next line's form
+        while (true) {
+            view.skipToStructural(false);
+            u32 offset = view.offset();
+            u8 b = view.peekByte();
+            if (b == '\0') break;
+            else if (b == '\n') {
+                view.read();
+                if (u8 last = lastByte(src, comment < offset ? comment : offset, lineStart))
+                    quoted = last == ':';
+                if (depth == 0 && !quoted && offset + 1 >= next && offset + 1 < src.size()) {
+                    splits.push(offset + 1);
+                    next = offset + 1 + target;
+                }
+                lineStart = offset + 1, comment = ~0u;
+            }
+            else if (b == '(' || b == '[') ++ depth, view.read();
+            else if (b == ')' || b == ']') -- depth, view.read();
+            else if (!(CLASS[b] & C_HIGH) && !startsToken(src, offset, lineStart, literalEnd)) 
+                view.read();
+            else if (b == '#') { // runs to the end of the line
+                comment = offset;
+                do view.read(), view.skipToStructural(false);
+                while ((b = view.peekByte()) != '\n' && b != '\0');
+            }
+            else if (b == '"') {
+                view.read();
+                while (view.skip(CLASS, C_STRING), (b = view.peekByte()) == '\\')
+                    view.read(), view.read();
+                if (b == '"') view.read();
+                literalEnd = view.offset();
+            }
+            else if (b == '\'') {
+                view.read();
+                if (view.peekByte() == '\\') view.read();
+                if (view.peekByte() != '\n') view.read();
+                if (view.peekByte() == '\'') view.read();
+                literalEnd = view.offset();
+            }
+            else view.read(); // non-ASCII
+        }
+        return splits;
+    }
 }
 
 void write(stream& io, const basil::Token& token) {
-    write(io, "[", token.id, ": ", token.name, "]");
+    write(io, "[", token.id, ": ", token.offset, "+", token.length, "]");
 }
\ No newline at end of file
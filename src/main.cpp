@@ -6,27 +6,83 @@
 #include "meta.h"
 #include "env.h"
 #include "builtin.h"
+#include "pool.h"
+#include "arena.h"
 
 using namespace basil;
 
 Env* createRootEnv() {
     Env* env = new Env();
-    env->enter("int", Meta(TYPE, INT));
-    env->enter("float", Meta(TYPE, FLOAT));
-    env->enter("type", Meta(TYPE, TYPE));
+    env->enter(findSymbol("int"), Meta(TYPE, INT));
+    env->enter(findSymbol("float"), Meta(TYPE, FLOAT));
+    env->enter(findSymbol("type"), Meta(TYPE, TYPE));
 
     const Type* builtinfn = find<FunctionType>(vector<const Type*>{ANY}, ANY);
-    env->enter("let", Meta(builtinfn, new MetaFunction(define)));
-    env->enter("lambda", Meta(builtinfn, new MetaFunction(lambda)));
-    env->enter("+", Meta(builtinfn, new MetaFunction(add)));
-    env->enter("-", Meta(builtinfn, new MetaFunction(subtract)));
-    env->enter("*", Meta(builtinfn, new MetaFunction(multiply)));
-    env->enter("/", Meta(builtinfn, new MetaFunction(divide)));
-    env->enter("quote", Meta(builtinfn, new MetaFunction(quote)));
-    env->enter("do", Meta(builtinfn, new MetaFunction(doBlock)));
+    env->enter(findSymbol("let"), Meta(builtinfn, new MetaFunction(define)));
+    env->enter(findSymbol("lambda"), Meta(builtinfn, new MetaFunction(lambda)));
+    env->enter(findSymbol("+"), Meta(builtinfn, new MetaFunction(add)));
+    env->enter(findSymbol("-"), Meta(builtinfn, new MetaFunction(subtract)));
+    env->enter(findSymbol("*"), Meta(builtinfn, new MetaFunction(multiply)));
+    env->enter(findSymbol("/"), Meta(builtinfn, new MetaFunction(divide)));
+    env->enter(findSymbol("quote"), Meta(builtinfn, new MetaFunction(quote)));
+    env->enter(findSymbol("do"), Meta(builtinfn, new MetaFunction(doBlock)));
     return env;
 }
 
+// A top-level form lowered earlier in the session. Lowering looks names up
+// in the global scope, so the form's node is only reused while every name
+// it mentions is still bound the way it was then. Reused nodes keep the
+// positions of the form they were first lowered from.
+struct Lowered {
+    const Term* term;
+    Node* node;
+    vector<i64> names;
+    vector<Meta> bindings;
+};
+
+static Meta binding(Env* global, i64 name) {
+    Entry* e = global->lookup(name);
+    return e ? e->meta : Meta();
+}
+
+static bool current(const Lowered& l, Env* global) {
+    for (u32 i = 0; i < l.names.size(); ++ i)
+        if (binding(global, l.names[i]) != l.bindings[i]) return false;
+    return true;
+}
+
+// lowers 'term', or finds a lowering of the same form that's still valid;
+// 'fresh' is set if the term itself had to be lowered
+static Node* lower(Term* term, Env* global, map<u64, Lowered*>& cache, bool& fresh) {
+    u64 h = term->hash();
+    auto it = cache.find(h);
+    Lowered* l = it == cache.end() ? nullptr : it->second;
+    if (l && l->term->equals(term) && current(*l, global)) {
+        fresh = false;
+        return l->node;
+    }
+
+    fresh = true;
+    vector<i64> names;
+    vector<Meta> bindings;
+    vector<const Term*> terms;
+    set<i64> seen;
+    flatten(term, terms);
+    for (const Term* t : terms) {
+        if (t->asBlock()) continue;
+        Meta q = t->quote();
+        if (!q.isSymbol() || seen.find(q.asSymbol()) != seen.end()) continue;
+        seen.insert(q.asSymbol());
+        names.push(q.asSymbol()), bindings.push(binding(global, q.asSymbol()));
+    }
+
+    Node* n = term->eval(global);
+    if (countErrors() || !n) return n;
+    if (!l) cache[h] = l = new Lowered();
+    l->term = term, l->node = n, l->names = names, l->bindings = bindings;
+    return n;
+}
+
 int repl() {
     Source src;
     useSource(&src);
@@ -35,60 +91,78 @@ int repl() {
     Env* global = new Env();
     global->setParent(root);
 
+    // Forms that were already lowered are looked up by their structure, so
+    // re-sent input skips straight to evaluation. Each line is parsed into
+    // its own arena, which is kept for the rest of the session if anything
+    // from it was lowered, since quotes and functions can refer back to it.
+    map<u64, Lowered*> cache;
+    vector<Arena*> arenas;
     while (true) {
-        vector<Token> tokens;
-
         print("? ");
-        Source::View view = src.expand(_stdin);
-        while (view.peek()) {
-            if (Token token = lex(view))
-                tokens.push(token);
-            if (countErrors()) {
-                printErrors(_stdout);
-                return 1;
-            }
-        }
+        _stdout.flush();
+        if (!_stdin.peek()) break;
+        TokenView tview(src.expand(_stdin));
+        Arena* arena = new Arena();
+        useArena(arena);
+        bool keep = false;
 
-        vector<Term*> terms;
-        TokenView tview(tokens);
+        println("");
         while (tview.peek()) {
-            if (Term* term = parse(tview))
-                terms.push(term);
+            Term* term = parse(tview);
             if (countErrors()) {
                 printErrors(_stdout);
                 return 1;
             }
-        }
+            if (!term) continue;
 
-        vector<Node*> nodes;
-        for (Term* t : terms) {
-            if (Node* n = t->eval(global)) nodes.push(n);
+            bool fresh;
+            Node* n = lower(term, global, cache, fresh);
+            keep = keep || fresh;
             if (countErrors()) {
                 printErrors(_stdout);
                 return 1;
             }
-        }
+            if (!n) continue;
 
-        println("");
-        for (Node* n : nodes) {
             Meta m = n->eval(global);
             if (countErrors()) {
                 printErrors(_stdout);
+                return 1;
             }
-            else if (m) println(m, " : ", m.type());
+            if (m) println(m, " : ", m.type());
+        }
+        if (countErrors()) {
+            printErrors(_stdout);
+            return 1;
         }
         println("");
-        if (countErrors()) return 1;
 
-        for (Term* t : terms) delete t;
+        useArena(nullptr);
+        if (keep) arenas.push(arena);
+        else delete arena;
     }
 
+    for (auto& entry : cache) delete entry.second;
+    for (Arena* arena : arenas) delete arena;
     delete global;
     delete root;
 
     return 0;
 }
 
+// lowers and evaluates a top-level term and prints its value, returning
+// false if it reported any errors
+static bool evaluate(Term* term, Env* global) {
+    Node* n = term->eval(global);
+    if (countErrors()) return false;
+    if (!n) return true;
+
+    Meta m = n->eval(global);
+    if (countErrors()) return false;
+    println(m, " : ", m.type());
+    return true;
+}
+
 int compile(const char* path) {
     Source src(path);
     useSource(&src);
@@ -97,56 +171,107 @@ int compile(const char* path) {
     Env* global = new Env();
     global->setParent(root);
 
-    vector<Token> tokens;
-    Source::View view = src.view();
-    while (view.peek()) {
-        if (Token token = lex(view))
-            tokens.push(token);
-        if (countErrors()) {
-            printErrors(_stdout);
-            return 1;
+    // each top-level term is lowered and evaluated in order as soon as it's 
+    // parsed; large sources are parsed up front on several threads instead.
+    // terms and nodes stay alive until the end, since quotes and functions
+    // can refer back to them
+    Arena arena;
+    useArena(&arena);
+    if (src.size() >= 2 * PARSE_CHUNK_SIZE) {
+        vector<Error> errors;
+        for (Term* term : parseAll(src, errors))
+            if (!evaluate(term, global)) break;
+        if (!countErrors()) for (const Error& e : errors) reportError(e);
+    }
+    else {
+        TokenView tview(src.view());
+        while (tview.peek()) {
+            Term* term = parse(tview);
+            if (countErrors()) break;
+            if (!term) continue;
+            if (!evaluate(term, global)) break;
         }
     }
+    if (countErrors()) {
+        printErrors(_stdout);
+        return 1;
+    }
+
+    arena.release();
+    delete global;
+    delete root;
 
+    return 0;
+}
+
+// a file from the command line, loaded and parsed ahead of evaluation
+struct Unit {
+    const char* path;
+    Source* src;
+    Arena* arena;
     vector<Term*> terms;
-    TokenView tview(tokens);
+    vector<Error> errors;
+};
+
+static void load(Unit& unit) {
+    unit.src = new Source(unit.path);
+    useSource(unit.src);
+    unit.arena = new Arena();
+    Arena* prev = useArena(unit.arena);
+    if (unit.src->size() >= 2 * PARSE_CHUNK_SIZE) {
+        unit.terms = parseAll(*unit.src, unit.errors);
+        useArena(prev);
+        return;
+    }
+    TokenView tview(unit.src->view());
     while (tview.peek()) {
-        if (Term* term = parse(tview))
-            terms.push(term);
-        if (countErrors()) {
-            printErrors(_stdout);
-            return 1;
-        }
+        Term* term = parse(tview);
+        if (countErrors()) break;
+        if (term) unit.terms.push(term);
     }
+    unit.errors = takeErrors();
+    useArena(prev);
+}
 
-    vector<Node*> nodes;
-    for (Term* t : terms) {
-        if (Node* n = t->eval(global)) nodes.push(n), n->eval(global);
-        if (countErrors()) {
-            printErrors(_stdout);
-            return 1;
-        }
-    }
+// Loads and parses all the files at once, then evaluates them one at a 
+// time in the order given. Each file gets its own global scope and its own
+// error report, and one failing doesn't stop the others.
+int compile(u32 count, char** paths) {
+    vector<Unit> units;
+    for (u32 i = 0; i < count; ++ i) units.push({ paths[i], nullptr });
+    parallel_for(units.size(), [&](u32 i) { load(units[i]); });
 
-    for (Node* n : nodes) {
-        Meta m = n->eval(global);
+    Env* root = createRootEnv();
+    int status = 0;
+    for (Unit& unit : units) {
+        useSource(unit.src);
+        useArena(unit.arena);
+        Env* global = new Env();
+        global->setParent(root);
+
+        bool ok = true;
+        for (Term* term : unit.terms) 
+            if (!(ok = evaluate(term, global))) break;
+        if (ok) for (const Error& e : unit.errors) reportError(e);
         if (countErrors()) {
+            write(_stdout, unit.path, ": ");
             printErrors(_stdout);
+            takeErrors();
+            status = 1;
         }
-        else println(m, " : ", m.type());
-    }
-    if (countErrors()) return 1;
-
-    for (Term* t : terms) delete t;
-    for (Node* n : nodes) delete n;
 
-    delete global;
+        delete unit.arena;
+        delete global;
+        delete unit.src;
+    }
+    useArena(nullptr);
     delete root;
 
-    return 0;
+    return status;
 }
 
 int main(int argc, char** argv) {
     if (argc < 2) return repl();
-    else return compile(argv[1]);
+    else if (argc == 2) return compile(argv[1]);
+    else return compile(argc - 1, argv + 1);
 }
\ No newline at end of file
@@ -3,17 +3,24 @@
 #include "io.h"
 #include "errors.h"
 #include "env.h"
+#include "num.h"
+#include <mutex>
+#include <new>
 
 namespace basil {
-    map<i64, ustring> symbolnames;
-    map<ustring, i64> symbolids;
-    i64 next = 0;
+    // symbols can be interned from several parsing threads at once; names
+    // are boxed so references to them stay valid as the table grows
+    static std::mutex symbolLock;
+    static vector<ustring*> symbolnames;
+    static map<ustring, i64> symbolids;
 
     i64 findSymbol(const ustring& name) {
+        std::lock_guard<std::mutex> guard(symbolLock);
         auto it = symbolids.find(name);
         if (it == symbolids.end()) {
-            i64 id = next ++;
-            symbolnames[symbolids[name] = id] = name;
+            i64 id = symbolnames.size();
+            symbolnames.push(new ustring(name));
+            symbolids[name] = id;
             return id;
         }
         return it->second;
@@ -22,11 +29,11 @@ namespace basil {
     static const ustring NO_SYMBOL;
 
     const ustring& findSymbol(i64 id) {
-        auto it = symbolnames.find(id);
-        if (it == symbolnames.end()) {
+        std::lock_guard<std::mutex> guard(symbolLock);
+        if (id < 0 || id >= symbolnames.size()) {
             return NO_SYMBOL;
         }
-        return it->second;
+        return *symbolnames[id];
     }
 
     // Meta
@@ -329,11 +336,23 @@ namespace basil {
         else if (isSymbol()) write(io, findSymbol(asSymbol()));
         else if (isString()) write(io, asString());
         else if (isArray()) {
-            write(io, "[");
+            // numbers are formatted straight into a local buffer, which is
+            // only handed to the stream when it fills up
+            u8 buf[256];
+            u32 n = 0;
+            buf[n ++] = '[';
             for (u32 i = 0; i < asArray().size(); i ++) {
-                write(io, i != 0 ? " " : "", asArray()[i]);
+                const Meta& m = asArray()[i];
+                if (n + NUMBER_BUFFER_SIZE + 2 > sizeof(buf)) io.write(buf, n), n = 0;
+                if (i != 0) buf[n ++] = ' ';
+                if (m.isInt()) 
+                    n += format_signed({ u32(sizeof(buf) - n), buf + n }, m.asInt());
+                else if (m.isFloat()) 
+                    n += format_float({ u32(sizeof(buf) - n), buf + n }, m.asFloat());
+                else io.write(buf, n), n = 0, m.format(io);
             }
-            write(io, "]");
+            buf[n ++] = ']';
+            io.write(buf, n);
         }
         else if (isUnion())
             write(io, asUnion().value());
@@ -566,18 +585,39 @@ namespace basil {
 
     // MetaFunction
 
-    MetaFunction::MetaFunction(Node* function, const vector<u32>& args, Env* local): 
-        fn(function), _args(args), _builtin(nullptr), _local(local) {
-        //
+    void* MetaFunction::operator new(size_t size) {
+        return ::operator new(size);
+    }
+
+    void* MetaFunction::operator new(size_t size, u32 ncaptures) {
+        return ::operator new(size + ncaptures * sizeof(Meta));
+    }
+
+    void MetaFunction::operator delete(void* p) {
+        ::operator delete(p);
+    }
+
+    void MetaFunction::operator delete(void* p, u32 ncaptures) {
+        ::operator delete(p);
+    }
+
+    MetaFunction::MetaFunction(Node* function, const Env* layout, Env* scope, 
+        const Meta* captures, u32 ncaptures): 
+        fn(function), _builtin(nullptr), _layout(layout), _scope(scope), 
+        _ncaptures(ncaptures) {
+        Meta* dest = (Meta*)(this + 1);
+        for (u32 i = 0; i < ncaptures; i ++) new (dest + i) Meta(captures[i]);
     }
 
     MetaFunction::MetaFunction(Builtin builtin): 
-        fn(nullptr), _builtin(builtin), _local(nullptr) {
+        fn(nullptr), _builtin(builtin), _layout(nullptr), _scope(nullptr),
+        _ncaptures(0) {
         //
     }
 
     MetaFunction::~MetaFunction() {
-        if (_local) delete _local;
+        Meta* captured = (Meta*)(this + 1);
+        for (u32 i = 0; i < _ncaptures; i ++) captured[i].~Meta();
     }
 
     Node* MetaFunction::function() const {
@@ -588,16 +628,26 @@ namespace basil {
         return _builtin;
     }
 
-    Env* MetaFunction::local() const {
-        return _local;
+    const Env* MetaFunction::layout() const {
+        return _layout;
+    }
+
+    Env* MetaFunction::scope() const {
+        return _scope;
+    }
+
+    const Meta* MetaFunction::captures() const {
+        return (const Meta*)(this + 1);
     }
 
-    Entry* MetaFunction::arg(u32 i) const {
-        return _local->entry(_args[i]);
+    u32 MetaFunction::ncaptures() const {
+        return _ncaptures;
     }
 
     Meta MetaFunction::clone(const Meta& src) const {
-        return Meta(src.type(), new MetaFunction(fn, _args, _local->fork()));
+        if (_builtin) return Meta(src.type(), new MetaFunction(_builtin));
+        return Meta(src.type(), new (_ncaptures) 
+            MetaFunction(fn, _layout, _scope, captures(), _ncaptures));
     }
 
     // Meta Ops
@@ -0,0 +1,273 @@
+#include "num.h"
+#include <string.h>
+
+static const char DIGIT_PAIRS[] = 
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const u64 POW10[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 
+    1000000000000ull, 10000000000000ull, 100000000000000ull, 
+    1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull
+};
+
+static u32 count_digits(u64 n) {
+    u32 count = 1;
+    while (count < 20 && n >= POW10[count]) ++ count;
+    return count;
+}
+
+// writes the digits of n so that they end just before 'end'
+static void write_digits(u8* end, u64 n) {
+    while (n >= 100) {
+        u32 pair = (n % 100) * 2;
+        n /= 100;
+        *(-- end) = DIGIT_PAIRS[pair + 1];
+        *(-- end) = DIGIT_PAIRS[pair];
+    }
+    if (n >= 10) {
+        *(-- end) = DIGIT_PAIRS[n * 2 + 1];
+        *(-- end) = DIGIT_PAIRS[n * 2];
+    }
+    else *(-- end) = '0' + n;
+}
+
+static u32 write_unsigned(u8* out, u64 n) {
+    u32 count = count_digits(n);
+    write_digits(out + count, n);
+    return count;
+}
+
+u32 format_unsigned(slice<u8> out, u64 n) {
+    if (out.size() < NUMBER_BUFFER_SIZE) return 0;
+    return write_unsigned(out.begin(), n);
+}
+
+u32 format_signed(slice<u8> out, i64 n) {
+    if (out.size() < NUMBER_BUFFER_SIZE) return 0;
+    if (n >= 0) return write_unsigned(out.begin(), n);
+    out[0] = '-';
+    return 1 + write_unsigned(out.begin() + 1, -u64(n));
+}
+
+// Shortest round-trip float formatting, following Loitsch's Grisu2 as
+// refined in Milo Yip's dtoa.
+
+struct diyfp {
+    u64 f;
+    i32 e;
+};
+
+static diyfp operator-(diyfp a, diyfp b) {
+    return { a.f - b.f, a.e };
+}
+
+static diyfp operator*(diyfp a, diyfp b) {
+    unsigned __int128 p = (unsigned __int128)a.f * b.f;
+    u64 h = p >> 64, l = u64(p);
+    if (l & (1ull << 63)) ++ h; // round
+    return { h, a.e + b.e + 64 };
+}
+
+static diyfp normalize(diyfp d) {
+    i32 shift = __builtin_clzll(d.f);
+    return { d.f << shift, d.e - shift };
+}
+
+static const u64 CACHED_POWERS_F[] = {
+    0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+    0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+    0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+    0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+    0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+    0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+    0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+    0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+    0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+    0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+    0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+    0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+    0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+    0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+    0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+    0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+    0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+    0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+    0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+    0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+    0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+    0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+    0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+    0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+    0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+    0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+    0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+    0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+    0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull,
+};
+
+static const i16 CACHED_POWERS_E[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+// finds a cached power of ten c = 10^-k such that the product of c and a
+// number with binary exponent e lands in a convenient range
+static diyfp cached_power(i32 e, i32& k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    i32 ik = i32(dk);
+    if (dk - ik > 0.0) ++ ik;
+    u32 index = u32((ik >> 3) + 1);
+    k = -(-348 + i32(index * 8));
+    return { CACHED_POWERS_F[index], CACHED_POWERS_E[index] };
+}
+
+static void grisu_round(u8* digits, u32 len, u64 delta, u64 rest, u64 ten_kappa, u64 wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa 
+        && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        -- digits[len - 1];
+        rest += ten_kappa;
+    }
+}
+
+static void digit_gen(diyfp w, diyfp mp, u64 delta, u8* digits, u32& len, i32& k) {
+    diyfp one = { 1ull << -mp.e, mp.e };
+    diyfp wp_w = mp - w;
+    u32 p1 = u32(mp.f >> -one.e);
+    u64 p2 = mp.f & (one.f - 1);
+    i32 kappa = count_digits(p1);
+    len = 0;
+    while (kappa > 0) {
+        u32 d = p1 / POW10[kappa - 1];
+        p1 %= POW10[kappa - 1];
+        if (d || len) digits[len ++] = '0' + d;
+        -- kappa;
+        u64 rest = (u64(p1) << -one.e) + p2;
+        if (rest <= delta) {
+            k += kappa;
+            grisu_round(digits, len, delta, rest, POW10[kappa] << -one.e, wp_w.f);
+            return;
+        }
+    }
+    while (true) {
+        p2 *= 10, delta *= 10;
+        u8 d = u8(p2 >> -one.e);
+        if (d || len) digits[len ++] = '0' + d;
+        p2 &= one.f - 1;
+        -- kappa;
+        if (p2 < delta) {
+            k += kappa;
+            grisu_round(digits, len, delta, p2, one.f, 
+                wp_w.f * (-kappa < 20 ? POW10[-kappa] : 0));
+            return;
+        }
+    }
+}
+
+// produces the shortest digits d such that d * 10^k reads back as v, given
+// v's significand f, binary exponent e, and hidden bit
+static void grisu2(u64 f, i32 e, u64 hidden, u8* digits, u32& len, i32& k) {
+    diyfp plus = normalize({ (f << 1) + 1, e - 1 });
+    diyfp minus = f == hidden ? diyfp{ (f << 2) - 1, e - 2 } : diyfp{ (f << 1) - 1, e - 1 };
+    minus.f <<= minus.e - plus.e, minus.e = plus.e;
+    diyfp c = cached_power(plus.e, k);
+    diyfp w = normalize({ f, e }) * c, wp = plus * c, wm = minus * c;
+    ++ wm.f, -- wp.f;
+    digit_gen(w, wp, wp.f - wm.f, digits, len, k);
+}
+
+// lays out 'len' digits scaled by 10^k, in fixed notation when the 
+// exponent is reasonable and scientific notation otherwise
+static u32 layout(u8* out, const u8* digits, i32 len, i32 k) {
+    i32 point = len + k;
+    u8* p = out;
+    if (k >= 0 && point <= 21) { // integral
+        memcpy(p, digits, len), p += len;
+        for (i32 i = 0; i < k; ++ i) *(p ++) = '0';
+        *(p ++) = '.', *(p ++) = '0';
+    }
+    else if (point > 0 && point <= 21) {
+        memcpy(p, digits, point), p += point;
+        *(p ++) = '.';
+        memcpy(p, digits + point, len - point), p += len - point;
+    }
+    else if (point > -6 && point <= 0) {
+        *(p ++) = '0', *(p ++) = '.';
+        for (i32 i = point; i < 0; ++ i) *(p ++) = '0';
+        memcpy(p, digits, len), p += len;
+    }
+    else {
+        *(p ++) = digits[0];
+        if (len > 1) *(p ++) = '.', memcpy(p, digits + 1, len - 1), p += len - 1;
+        *(p ++) = 'e';
+        i32 exp = point - 1;
+        if (exp < 0) *(p ++) = '-', exp = -exp;
+        p += write_unsigned(p, exp);
+    }
+    return p - out;
+}
+
+static u32 format_special(u8* out, bool negative, bool nan) {
+    u8* p = out;
+    if (negative && !nan) *(p ++) = '-';
+    memcpy(p, nan ? "nan" : "inf", 3);
+    return p + 3 - out;
+}
+
+u32 format_float(slice<u8> out, double d) {
+    if (out.size() < NUMBER_BUFFER_SIZE) return 0;
+    u64 bits;
+    memcpy(&bits, &d, sizeof(bits));
+    bool negative = bits >> 63;
+    u32 exponent = (bits >> 52) & 0x7ff;
+    u64 significand = bits & ((1ull << 52) - 1);
+    if (exponent == 0x7ff) 
+        return format_special(out.begin(), negative, significand);
+
+    u8* p = out.begin();
+    if (negative) *(p ++) = '-';
+    if (!exponent && !significand) return memcpy(p, "0.0", 3), p + 3 - out.begin();
+
+    u64 hidden = 1ull << 52;
+    u64 f = exponent ? significand | hidden : significand;
+    i32 e = exponent ? i32(exponent) - 1075 : -1074;
+    u8 digits[20];
+    u32 len;
+    i32 k;
+    grisu2(f, e, hidden, digits, len, k);
+    return p + layout(p, digits, len, k) - out.begin();
+}
+
+u32 format_float(slice<u8> out, float fl) {
+    if (out.size() < NUMBER_BUFFER_SIZE) return 0;
+    u32 bits;
+    memcpy(&bits, &fl, sizeof(bits));
+    bool negative = bits >> 31;
+    u32 exponent = (bits >> 23) & 0xff;
+    u32 significand = bits & ((1u << 23) - 1);
+    if (exponent == 0xff) 
+        return format_special(out.begin(), negative, significand);
+
+    u8* p = out.begin();
+    if (negative) *(p ++) = '-';
+    if (!exponent && !significand) return memcpy(p, "0.0", 3), p + 3 - out.begin();
+
+    u64 hidden = 1ull << 23;
+    u64 f = exponent ? significand | hidden : significand;
+    i32 e = exponent ? i32(exponent) - 150 : -149;
+    u8 digits[20];
+    u32 len;
+    i32 k;
+    grisu2(f, e, hidden, digits, len, k);
+    return p + layout(p, digits, len, k) - out.begin();
+}
@@ -5,6 +5,11 @@
 #include "type.h"
 #include "errors.h"
 #include "builtin.h"
+#include "str.h"
+#include "source.h"
+#include "env.h"
+#include "pool.h"
+#include "arena.h"
 
 namespace basil {
     Term::Term(u32 line, u32 column):
@@ -16,6 +21,14 @@ namespace basil {
         //
     }
 
+    void* Term::operator new(size_t size) {
+        return currentArena()->alloc(size);
+    }
+
+    void Term::operator delete(void* p) {
+        //
+    }
+
     u32 Term::line() const {
         return _line;
     }
@@ -24,16 +37,68 @@ namespace basil {
         return _column;
     }
 
-    BlockTerm::BlockTerm(const vector<Term*> terms, u32 line, u32 column):
-        Term(line, column), _terms(terms) {
-        //
+    // structure only - terms in different places with the same contents
+    // hash the same and compare equal
+
+    // scratch space for walking terms, reused between calls
+    static thread_local vector<const Term*> walkA, walkB, walkStack;
+
+    u64 Term::hash() const {
+        vector<const Term*>& terms = walkA;
+        terms.clear(), flatten(this, terms);
+        u64 h = 0;
+        for (const Term* t : terms) {
+            const BlockTerm* b = t->asBlock();
+            h = rotl(h, 7) ^ (b ? ::hash(b->terms().size()) : t->quote().hash());
+        }
+        return h;
+    }
+
+    bool Term::equals(const Term* other) const {
+        vector<const Term*> &a = walkA, &b = walkB;
+        a.clear(), b.clear();
+        flatten(this, a), flatten(other, b);
+        if (a.size() != b.size()) return false;
+        for (u32 i = 0; i < a.size(); ++ i) {
+            const BlockTerm *ab = a[i]->asBlock(), *bb = b[i]->asBlock();
+            if (ab || bb) {
+                if (!ab || !bb || ab->terms().size() != bb->terms().size()) return false;
+            }
+            else if (a[i]->quote() != b[i]->quote()) return false;
+        }
+        return true;
+    }
+
+    const BlockTerm* Term::asBlock() const {
+        return nullptr;
+    }
+
+    void flatten(const Term* term, vector<const Term*>& out) {
+        vector<const Term*>& stack = walkStack;
+        stack.clear(), stack.push(term);
+        while (stack.size()) {
+            const Term* t = stack.back();
+            stack.pop();
+            out.push(t);
+            if (const BlockTerm* b = t->asBlock()) 
+                for (u32 i = b->terms().size(); i > 0; -- i) stack.push(b->terms()[i - 1]);
+        }
     }
 
-    BlockTerm::~BlockTerm() {
-        for (Term* t : _terms) delete t;
+    // children are copied into an array of exactly the right size, next to
+    // the terms themselves
+    static const_slice<Term*> arenaCopy(const_slice<Term*> terms) {
+        Term** data = (Term**)currentArena()->alloc(terms.size() * sizeof(Term*));
+        for (u32 i = 0; i < terms.size(); ++ i) data[i] = terms[i];
+        return { terms.size(), data };
+    }
+
+    BlockTerm::BlockTerm(const_slice<Term*> terms, u32 line, u32 column):
+        Term(line, column), _terms(arenaCopy(terms)) {
+        //
     }
 
-    const vector<Term*>& BlockTerm::terms() const {
+    const_slice<Term*> BlockTerm::terms() const {
         return _terms;
     }
 
@@ -48,26 +113,66 @@ namespace basil {
             return call(env, n, this); // todo: call
         err(PHASE_TYPE, _terms[0]->line(), _terms[0]->column(),
             "First term in block is not a type or function.");
-        delete n;
         return nullptr;
     }
 
+    const BlockTerm* BlockTerm::asBlock() const {
+        return this;
+    }
+
+    // nested blocks are walked with explicit stacks in quote() and format(),
+    // so deep nesting doesn't run out of call stack
+
+    struct QuoteFrame {
+        const BlockTerm* block;
+        u32 next, start; // next child, and where its values start
+    };
+
     Meta BlockTerm::quote() const {
-        vector<Meta> metas;
-        set<const Type*> types;
-        for (Term* t : _terms) 
-            metas.push(t->quote()), types.insert(metas.back().type());
-        const Type* type = types.size() == 1 ? *types.begin() : find<SumType>(types);
-        return Meta(find<ArrayType>(type, metas.size()), new MetaArray(metas));
+        vector<QuoteFrame> stack;
+        vector<Meta> values;
+        stack.push({ this, 0, 0 });
+        while (true) {
+            QuoteFrame& f = stack.back();
+            if (f.next < f.block->_terms.size()) {
+                const Term* t = f.block->_terms[f.next ++];
+                if (const BlockTerm* b = t->asBlock()) 
+                    stack.push({ b, 0, values.size() });
+                else values.push(t->quote());
+                continue;
+            }
+
+            vector<Meta> metas;
+            set<const Type*> types;
+            for (u32 i = f.start; i < values.size(); ++ i) 
+                metas.push(values[i]), types.insert(values[i].type());
+            const Type* type = types.size() == 1 ? *types.begin() : find<SumType>(types);
+            Meta m(find<ArrayType>(type, metas.size()), new MetaArray(metas));
+
+            while (values.size() > f.start) values.pop();
+            stack.pop();
+            if (!stack.size()) return m;
+            values.push(m);
+        }
     }
 
     void BlockTerm::format(stream& io) const {
+        vector<pair<const BlockTerm*, u32>> stack;
         write(io, "(");
-        for (Term* t : _terms) {
-            t->format(io);
-            if (t != _terms[_terms.size() - 1]) write(io, " ");
+        stack.push({ this, 0 });
+        while (stack.size()) {
+            pair<const BlockTerm*, u32>& top = stack.back();
+            if (top.second == top.first->_terms.size()) {
+                write(io, ")");
+                stack.pop();
+                continue;
+            }
+            const Term* t = top.first->_terms[top.second ++];
+            if (top.second > 1) write(io, " ");
+            if (const BlockTerm* b = t->asBlock())
+                write(io, "("), stack.push({ b, 0 });
+            else t->format(io);
         }
-        write(io, ")");
     }
 
     IntTerm::IntTerm(i64 value, u32 line, u32 column):
@@ -121,7 +226,7 @@ namespace basil {
         write(io, '\'', escape(ustring() + _value), '\'');
     }
 
-    StringTerm::StringTerm(const ustring& value, u32 line, u32 column):
+    StringTerm::StringTerm(const_slice<uchar> value, u32 line, u32 column):
         Term(line, column), _value(value) {
         //
     }
@@ -131,20 +236,29 @@ namespace basil {
     }
 
     Meta StringTerm::quote() const {
-        return Meta(STRING, _value);
+        return Meta(STRING, ustring(_value));
     }
 
     void StringTerm::format(stream& io) const {
         write(io, '"', escape(_value), '"');
     }
 
-    VariableTerm::VariableTerm(const ustring& name, u32 line, u32 column):
+    VariableTerm::VariableTerm(i64 name, u32 line, u32 column):
         Term(line, column), _name(name) {
         //
     }
 
+    // Names bound to numbers are folded into constants. Bindings can't be
+    // reassigned, and let and lambda arguments refuse to rebind a name that's
+    // in scope, so only locals of the functions being lowered can shadow one.
     Node* VariableTerm::eval(Env* env) const {
-        return new Variable(_name, line(), column());
+        if (!isLocal(_name)) {
+            const Entry* entry = env->lookup(_name);
+            if (entry && (entry->meta.isInt() || entry->meta.isFloat()))
+                return new Constant(entry->meta, line(), column());
+        }
+
+        return new Variable(_name, locate(env, _name), line(), column());
     }
 
     Meta VariableTerm::quote() const {
@@ -152,96 +266,162 @@ namespace basil {
     }
 
     void VariableTerm::format(stream& io) const {
-        write(io, _name);
+        write(io, findSymbol(_name));
     }
 
-    Term* parse(TokenView& view);
-
-    static i64 stringToInt(const ustring& s) {
-        buffer b;
-        i64 i;
-        write(b, s);
-        read(b, i);
-        return i;
+    // unescaped string literals are decoded straight from the source into
+    // the arena; escaped ones were already interned by the lexer
+    static const_slice<uchar> stringValue(const TokenView& view, const Token& t) {
+        if (t.symbol >= 0) {
+            const ustring& s = findSymbol(t.symbol);
+            return s[{ 0, s.size() }];
+        }
+        const_slice<u8> text = view.text(t);
+        uchar* data = (uchar*)currentArena()->alloc(text.size() * sizeof(uchar));
+        u32 n = 0;
+        for (u32 i = 1; i + 1 < text.size(); ) {
+            uchar c((const char*)&text[i]);
+            data[n ++] = c, i += c.size();
+        }
+        return { n, data };
     }
 
-    static double stringToFloat(const ustring& s) {
-        buffer b;
-        double d;
-        write(b, s);
-        read(b, d);
-        return d;
-    }
+    // a block, array or quote that has been opened but not finished yet
+    struct OpenTerm {
+        u32 start, line, column;
+        u32 close; // T_NONE for a quote, which wraps exactly one term
+    };
 
-    Term* parseArray(TokenView& view) {
-        u32 line = view.peek().line, column = view.peek().column;
-        view.read();
-        vector<Term*> contents = { new VariableTerm("array", line, column) };
-        while (view.peek().id != T_RBRACK) {
-            if (view.peek().id == T_NONE) {
-                err(PHASE_PARSE, view.peek().line, view.peek().column,
-                    "Unexpected end of file.");
-                for (Term* t : contents) delete t;
-                return nullptr;
+    // Nesting is tracked on an explicit stack rather than the call stack, 
+    // so deeply nested input is only limited by memory. Children of every 
+    // open term share one stack, and are copied out when their term closes.
+    Term* parse(TokenView& view) {
+        static const i64 ARRAY = findSymbol("array"), QUOTE = findSymbol("quote");
+        static thread_local vector<OpenTerm> open;
+        static thread_local vector<Term*> items;
+        open.clear(), items.clear();
+
+        while (true) {
+            Token t = view.peek(); // copied, since reading may refill the view
+            u32 line = view.line(t), column = view.column(t);
+            Term* term = nullptr;
+            switch (t.id) {
+                case T_INT:
+                    view.read();
+                    term = new IntTerm(t.intval, line, column);
+                    break;
+                case T_FLOAT:
+                    view.read();
+                    term = new FloatTerm(t.floatval, line, column);
+                    break;
+                case T_STRING:
+                    view.read();
+                    term = new StringTerm(stringValue(view, t), line, column);
+                    break;
+                case T_CHAR:
+                    view.read();
+                    term = new CharTerm(uchar(t.charval[0], t.charval[1], 
+                        t.charval[2], t.charval[3]), line, column);
+                    break;
+                case T_IDENT:
+                    view.read();
+                    term = new VariableTerm(t.symbol, line, column);
+                    break;
+                case T_QUOTE:
+                    view.read();
+                    open.push({ items.size(), line, column, T_NONE });
+                    items.push(new VariableTerm(QUOTE, line, column));
+                    continue;
+                case T_LPAREN:
+                    view.read();
+                    open.push({ items.size(), line, column, T_RPAREN });
+                    continue;
+                case T_LBRACK:
+                    view.read();
+                    open.push({ items.size(), line, column, T_RBRACK });
+                    items.push(new VariableTerm(ARRAY, line, column));
+                    continue;
+                default:
+                    if (open.size() && open.back().close != T_NONE) {
+                        const OpenTerm& o = open.back();
+                        if (t.id == o.close) {
+                            view.read();
+                            term = new BlockTerm(items[{ o.start, items.size() }], 
+                                o.line, o.column);
+                            while (items.size() > o.start) items.pop();
+                            open.pop();
+                            break;
+                        }
+                        if (t.id == T_NONE) {
+                            if (!countErrors()) // input may have ended at a lexer error
+                                err(PHASE_PARSE, line, column, "Unexpected end of file.");
+                            return nullptr;
+                        }
+                    }
+                    err(PHASE_PARSE, line, column,
+                        "Unexpected token '", view.text(t), "'.");
+                    view.read();
+                    break;
             }
-            if (Term* t = parse(view))
-                contents.push(t);
-        }
-        view.read();
-        return new BlockTerm(contents, line, column);
-    }
-
-    Term* parseBlock(TokenView& view) {
-        u32 line = view.peek().line, column = view.peek().column;
-        view.read();
-        vector<Term*> contents;
-        while (view.peek().id != T_RPAREN) {
-            if (view.peek().id == T_NONE) {
-                err(PHASE_PARSE, view.peek().line, view.peek().column,
-                    "Unexpected end of file.");
-                for (Term* t : contents) delete t;
-                return nullptr;
+
+            // a finished term closes any quotes waiting on it, then joins the
+            // innermost open block - unless it's the whole form
+            while (open.size() && open.back().close == T_NONE) {
+                const OpenTerm& o = open.back();
+                items.push(term);
+                term = new BlockTerm(items[{ o.start, items.size() }], o.line, o.column);
+                items.pop(), items.pop();
+                open.pop();
             }
-            if (Term* t = parse(view))
-                contents.push(t);
+            if (!open.size()) return term;
+            if (term) items.push(term);
         }
-        view.read();
-        return new BlockTerm(contents, line, column);
     }
 
-    Term* parse(TokenView& view) {
-        const Token& t = view.peek();
-        switch (t.id) {
-            case T_INT:
-                view.read();
-                return new IntTerm(stringToInt(t.name), t.line, t.column);
-            case T_FLOAT:
-                view.read();
-                return new FloatTerm(stringToFloat(t.name), t.line, t.column);
-            case T_STRING:
-                view.read();
-                return new StringTerm(t.name, t.line, t.column);
-            case T_CHAR:
-                view.read();
-                return new CharTerm(t.name[0], t.line, t.column);
-            case T_IDENT:
-                view.read();
-                return new VariableTerm(t.name, t.line, t.column);
-            case T_QUOTE:
-                view.read();
-                return new BlockTerm({
-                    new VariableTerm("quote", t.line, t.column),
-                    parse(view)
-                }, t.line, t.column);
-            case T_LPAREN:
-                return parseBlock(view);
-            case T_LBRACK:
-                return parseArray(view);
-            default:
-                err(PHASE_PARSE, t.line, t.column,
-                    "Unexpected token '", t.name, "'.");
-                return nullptr;
+    struct ParsedRange {
+        u32 start, end;
+        Arena* arena;
+        vector<Term*> terms;
+        vector<Error> errors;
+    };
+
+    static void parseRange(const Source& src, ParsedRange& range) {
+        useSource(&src);
+        Arena* prev = useArena(range.arena);
+        Source::View view = src.view();
+        view.seek(range.start), view.limit(range.end);
+        TokenView tview(view);
+        while (tview.peek()) {
+            Term* term = parse(tview);
+            if (countErrors()) break;
+            if (term) range.terms.push(term);
+        }
+        range.errors = takeErrors();
+        useArena(prev);
+    }
+
+    vector<Term*> parseAll(const Source& src, vector<Error>& errors) {
+        vector<ParsedRange> ranges;
+        u32 start = 0;
+        for (u32 split : splitForms(src, PARSE_CHUNK_SIZE)) 
+            ranges.push({ start, split, new Arena() }), start = split;
+        ranges.push({ start, src.size(), new Arena() });
+
+        parallel_for(ranges.size(), [&](u32 i) { parseRange(src, ranges[i]); });
+
+        // each range was parsed into its own arena, and the ones we keep are
+        // handed over to the caller's
+        vector<Term*> terms;
+        bool failed = false;
+        for (ParsedRange& range : ranges) {
+            if (!failed) {
+                for (Term* t : range.terms) terms.push(t);
+                currentArena()->absorb(*range.arena);
+                if (range.errors.size()) errors = range.errors, failed = true;
+            }
+            delete range.arena; // nothing after the first error is used
         }
+        return terms;
     }
 }
 
@@ -0,0 +1,123 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASIL_SCAN_X86
+#endif
+
+static bool is_space(u8 c) {
+    return c == ' ' || (c >= 0x08 && c <= 0x0D);
+}
+
+static bool is_structural(u8 c) {
+    switch (c) {
+        case '(': case ')': case '[': case ']': 
+        case '"': case '\'': case '#': case '\n': case '\0':
+            return true;
+        default:
+            return c >= 0x80;
+    }
+}
+
+static void scan_block(const u8* data, u32 size, u64& space, u64& structural) {
+    space = 0, structural = 0;
+    for (u32 i = 0; i < 64; ++ i) {
+        u8 c = i < size ? data[i] : '\0';
+        if (is_space(c)) space |= u64(1) << i;
+        if (is_structural(c)) structural |= u64(1) << i;
+    }
+}
+
+static void scan_scalar(const u8* data, u32 size, u64* space, u64* structural) {
+    for (u32 i = 0; i < size; i += 64)
+        scan_block(data + i, size - i, space[i / 64], structural[i / 64]);
+}
+
+#ifdef BASIL_SCAN_X86
+
+// Whitespace is ' ' or 0x08-0x0D, which we check as an unsigned c - 8 <= 5.
+// Of the structural characters, ( ) and " # differ only in their low bit.
+
+__attribute__((target("sse2")))
+static u32 classify16(__m128i x, u32& space) {
+    __m128i low = _mm_sub_epi8(x, _mm_set1_epi8(0x08));
+    __m128i sp = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+        _mm_cmpeq_epi8(_mm_min_epu8(low, _mm_set1_epi8(0x05)), low));
+    __m128i odd = _mm_or_si128(x, _mm_set1_epi8(1));
+    __m128i st = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(odd, _mm_set1_epi8(')')), 
+            _mm_cmpeq_epi8(odd, _mm_set1_epi8('#'))),
+        _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('[')), 
+                _mm_cmpeq_epi8(x, _mm_set1_epi8(']'))),
+            _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\'')),
+                _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')), 
+                    _mm_cmpeq_epi8(x, _mm_setzero_si128())))));
+    space = u32(_mm_movemask_epi8(sp));
+    return u32(_mm_movemask_epi8(st) | _mm_movemask_epi8(x));
+}
+
+__attribute__((target("sse2")))
+static void scan_sse2(const u8* data, u32 size, u64* space, u64* structural) {
+    u32 i = 0;
+    for (; i + 64 <= size; i += 64) {
+        u64 sp = 0, st = 0;
+        for (u32 j = 0; j < 64; j += 16) {
+            u32 s;
+            st |= u64(classify16(_mm_loadu_si128((const __m128i*)(data + i + j)), s)) << j;
+            sp |= u64(s) << j;
+        }
+        space[i / 64] = sp, structural[i / 64] = st;
+    }
+    if (i < size) scan_block(data + i, size - i, space[i / 64], structural[i / 64]);
+}
+
+__attribute__((target("avx2")))
+static u32 classify32(__m256i x, u32& space) {
+    __m256i low = _mm256_sub_epi8(x, _mm256_set1_epi8(0x08));
+    __m256i sp = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+        _mm256_cmpeq_epi8(_mm256_min_epu8(low, _mm256_set1_epi8(0x05)), low));
+    __m256i odd = _mm256_or_si256(x, _mm256_set1_epi8(1));
+    __m256i st = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(odd, _mm256_set1_epi8(')')), 
+            _mm256_cmpeq_epi8(odd, _mm256_set1_epi8('#'))),
+        _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('[')), 
+                _mm256_cmpeq_epi8(x, _mm256_set1_epi8(']'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')),
+                _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')), 
+                    _mm256_cmpeq_epi8(x, _mm256_setzero_si256())))));
+    space = u32(_mm256_movemask_epi8(sp));
+    return u32(_mm256_movemask_epi8(st) | _mm256_movemask_epi8(x));
+}
+
+__attribute__((target("avx2")))
+static void scan_avx2(const u8* data, u32 size, u64* space, u64* structural) {
+    u32 i = 0;
+    for (; i + 64 <= size; i += 64) {
+        u32 s0, s1;
+        u64 st0 = classify32(_mm256_loadu_si256((const __m256i*)(data + i)), s0);
+        u64 st1 = classify32(_mm256_loadu_si256((const __m256i*)(data + i + 32)), s1);
+        space[i / 64] = u64(s0) | u64(s1) << 32;
+        structural[i / 64] = st0 | st1 << 32;
+    }
+    if (i < size) scan_block(data + i, size - i, space[i / 64], structural[i / 64]);
+}
+
+#endif
+
+using scan_function = void(*)(const u8*, u32, u64*, u64*);
+
+static scan_function choose_scan() {
+#ifdef BASIL_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scan_avx2;
+    if (__builtin_cpu_supports("sse2")) return scan_sse2;
+#endif
+    return scan_scalar;
+}
+
+void scan_bytes(const u8* data, u32 size, u64* space, u64* structural) {
+    static const scan_function scan = choose_scan();
+    scan(data, size, space, structural);
+}
@@ -1,101 +1,330 @@
 #include "source.h"
+#include "scan.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace basil {
+    void Source::reserve(u32 size) {
+        if (chunks.size() && chunks.back().capacity - chunks.back().size >= size) 
+            return;
+
+        // move the line we're in the middle of into the new chunk, so that
+        // it stays contiguous
+        u32 partial = chunks.size() ? _size - lines.back() : 0;
+        u32 capacity = SOURCE_CHUNK_SIZE;
+        while (capacity < partial + size) capacity *= 2;
+        Chunk chunk = { new u8[capacity], lines.back(), partial, capacity,
+            new u64[capacity / 64], new u64[capacity / 64], 0 };
+        if (partial) {
+            Chunk& last = chunks.back();
+            memcpy(chunk.data, last.data + (lines.back() - last.start), partial);
+            last.size -= partial;
+        }
+        chunks.push(chunk);
+    }
+
+    void Source::append(const u8* data, u32 size) {
+        reserve(size);
+        Chunk& chunk = chunks.back();
+        memcpy(chunk.data + chunk.size, data, size);
+        chunk.size += size, _size += size;
+    }
+
     void Source::add(uchar c) {
-        if (c == '\t') text += "    "; // expand tabs to 4 spaces
-        else text += c;
-        if (c == '\n') lines.push(text.size());
+        if (c == '\t') append((const u8*)"    ", 4); // expand tabs to 4 spaces
+        else append(&c[0], c.size());
+        if (c == '\n') lines.push(_size);
     }
 
-    Source::Source() {
+    const Source::Chunk& Source::chunkOf(u32 offset) const {
+        u32 l = 0, h = chunks.size();
+        while (h - l > 1) {
+            u32 m = (l + h) / 2;
+            if (chunks[m].start <= offset) l = m;
+            else h = m;
+        }
+        return chunks[l];
+    }
+
+    // brings the whitespace and structural bitmaps up to date with the text
+    void Source::index() {
+        for (u32 i = chunks.size(); i > 0; -- i) {
+            Chunk& chunk = chunks[i - 1];
+            if (chunk.scanned >= chunk.size) break;
+            u32 from = chunk.scanned & ~63u;
+            scan_bytes(chunk.data + from, chunk.size - from, 
+                chunk.space + from / 64, chunk.structural + from / 64);
+            chunk.scanned = chunk.size;
+        }
+    }
+
+    const u8* Source::data(u32 offset) const {
+        if (!chunks.size()) return nullptr;
+        const Chunk& chunk = chunkOf(offset);
+        return chunk.data + (offset - chunk.start);
+    }
+
+    Source::Source(): _size(0) {
         lines.push(0);
     }
 
-    Source::Source(const char* path) {
+    // returns false for anything we can't map (pipes, terminals, etc)
+    bool Source::map(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) 
+            return close(fd), false;
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) return close(fd), false;
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        reserve(st.st_size);
+        load((const u8*)data, st.st_size);
+        munmap(data, st.st_size);
+        close(fd);
+        return true;
+    }
+
+    Source::Source(const char* path): _size(0) {
         lines.push(0);
-        file f(path, "r");
-        load(f);
+        if (!map(path)) {
+            file f(path, "r");
+            load(f);
+        }
     }
 
-    Source::Source(stream& f) {
+    Source::Source(stream& f): _size(0) {
         lines.push(0);
         load(f);
     }
 
-    Source::View::View(const Source* src_in): src(src_in), 
-        _line(0), _column(0), _data(&src->text[0]) {
+    Source::~Source() {
+        for (Chunk& chunk : chunks) {
+            delete[] chunk.data;
+            delete[] chunk.space;
+            delete[] chunk.structural;
+        }
+    }
+
+    Source::View::View(const Source* src_in): src(src_in), _offset(0), _end(~0u),
+        _chunk(nullptr), _space(nullptr), _structural(nullptr), _lo(0), _hi(0), 
+        _mark(0), _markLine(0), _markColumn(0) {
         //  
     }
 
     Source::View::View(const Source* src_in, u32 line, u32 column): 
-        src(src_in), _line(line), _column(column), 
-        _data(&src->text[src->lines[line] + column]) {
-        //  
+        src(src_in), _offset(src->lines[line]), _end(~0u), _chunk(nullptr), 
+        _space(nullptr), _structural(nullptr), _lo(0), _hi(0),
+        _mark(_offset), _markLine(line), _markColumn(0) {
+        while (column --) read();
     }
 
-    void Source::View::rewind() {
-        if (_column == 0 && _line > 0) {
-            -- _data;
-            -- _line, _column = _data - (&src->text[src->lines[_line]]);
+    bool Source::View::fetch() const {
+        if (_offset >= src->_size || _offset >= _end) return false;
+        const Chunk& chunk = src->chunkOf(_offset);
+        _chunk = chunk.data, _lo = chunk.start, _hi = chunk.start + chunk.size;
+        if (_hi > _end) _hi = _end;
+        _space = chunk.space, _structural = chunk.structural;
+        return true;
+    }
+
+    // finds the line and column of the current offset, picking up from the
+    // last position we computed when we're still on the same line
+    void Source::View::locate() const {
+        if (_offset == _mark) return;
+        u32 next = _markLine + 1 < src->lines.size() 
+            ? src->lines[_markLine + 1] : src->_size + 1;
+        if (_offset < _mark || _offset >= next) {
+            _markLine = src->lineOf(_offset) - 1;
+            _mark = src->lines[_markLine], _markColumn = 0;
         }
-        else if (_column > 0) -- _data, -- _column;
+        const u8* text = src->data(_mark);
+        for (u32 i = 0; i < _offset - _mark; ++ i)
+            if ((text[i] & 0xC0) != 0x80) ++ _markColumn;
+        _mark = _offset;
+    }
+
+    void Source::View::rewind() {
+        if (_offset == 0) return;
+        -- _offset;
+        while (_offset > 0 && (*src->data(_offset) & 0xC0) == 0x80) -- _offset;
+    }
+
+    void Source::View::seek(u32 offset) {
+        _offset = offset;
     }
 
-    const_slice<uchar> Source::View::operator[](pair<u32, u32> range) const {
-        return { range.second - range.first, _data + range.first };
+    // makes the view behave as if the source ended at 'end'
+    void Source::View::limit(u32 end) {
+        _end = end, _lo = _hi = 0;
+    }
+
+    const_slice<u8> Source::View::operator[](pair<u32, u32> range) const {
+        return { range.second - range.first, src->data(_offset) + range.first };
     }
 
     uchar Source::View::read() {
         uchar c = peek();
-        ++ _column;
-        if (_column >= src->line(_line).size() && _line < src->lines.size() - 1) {
-            _column = 0, ++ _line;
-        } 
+        _offset += c ? c.size() : 0;
         return c;
     }
 
     uchar Source::View::peek() const {
-        if (_line >= src->lines.size()) return '\0';
-        if (_line == src->lines.size() - 1 
-            && _column >= src->line(_line).size()) return '\0';
-        return src->line(_line)[_column];
+        if (_offset - _lo >= _hi - _lo && !fetch()) return '\0';
+        const u8* p = _chunk + (_offset - _lo);
+        if (*p < 128) return uchar(*p);
+        return uchar((const char*)p);
+    }
+
+    u8 Source::View::peekByte() const {
+        if (_offset - _lo >= _hi - _lo && !fetch()) return '\0';
+        return _chunk[_offset - _lo];
+    }
+
+    // advances over bytes whose entry in table shares a bit with mask, 
+    // and returns how many were skipped; tables that match any byte of a 
+    // multibyte character must match all of its bytes
+    u32 Source::View::skip(const u8* table, u8 mask) {
+        u32 start = _offset;
+        while (_offset - _lo < _hi - _lo || fetch()) {
+            const u8* p = _chunk + (_offset - _lo), *end = _chunk + (_hi - _lo);
+            while (p != end && table[*p] & mask) ++ p;
+            _offset = _lo + u32(p - _chunk);
+            if (p != end) break;
+        }
+        return _offset - start;
+    }
+
+    // offset of the first byte at or after 'offset' whose bit is set in 
+    // either bitmap (after flipping 'a'), or 'hi' if there isn't one. bits 
+    // past the end of the chunk may be stale, so we never trust them
+    static u32 nextBit(const u64* a, u64 flip, const u64* b, 
+                       u32 lo, u32 hi, u32 offset) {
+        u32 i = offset - lo, n = hi - lo;
+        while (i < n) {
+            u64 word = ((a[i / 64] ^ flip) | (b ? b[i / 64] : 0)) >> (i % 64);
+            if (word) {
+                i += __builtin_ctzll(word);
+                break;
+            }
+            i = (i / 64 + 1) * 64;
+        }
+        return lo + (i < n ? i : n);
+    }
+
+    u32 Source::View::skipSpace() {
+        u32 start = _offset;
+        while (_offset - _lo < _hi - _lo || fetch()) {
+            _offset = nextBit(_space, ~0ull, nullptr, _lo, _hi, _offset);
+            if (_offset != _hi) break;
+        }
+        return _offset - start;
+    }
+
+    // advances to the next structural byte, or whitespace too if 'space'
+    u32 Source::View::skipToStructural(bool space) {
+        u32 start = _offset;
+        while (_offset - _lo < _hi - _lo || fetch()) {
+            _offset = nextBit(_structural, 0, space ? _space : nullptr, _lo, _hi, _offset);
+            if (_offset != _hi) break;
+        }
+        return _offset - start;
+    }
+
+    u32 Source::View::offset() const {
+        return _offset;
     }
 
     u32 Source::View::line() const {
-        return _line + 1;
+        locate();
+        return _markLine + 1;
     }
 
     u32 Source::View::column() const {
-        return _column + 1;
+        locate();
+        return _markColumn + 1;
     }
 
     const Source* Source::View::source() const {
         return src;
     }
 
+    // length of the longest prefix of data that doesn't end mid-character
+    static u32 complete(const u8* data, u32 size) {
+        for (u32 i = size; i > 0 && size - i < 4; -- i) {
+            if ((data[i - 1] & 0xC0) == 0x80) continue;
+            u32 n = uchar(data[i - 1]).size();
+            return n && i - 1 + n > size ? i - 1 : size;
+        }
+        return size;
+    }
+
     void Source::load(stream& f) {
-        uchar c;
-        while (f.peek()) read(f, c), add(c);
+        u8 buf[4096];
+        u32 carry = 0;
+        while (u32 n = f.read(buf + carry, sizeof(buf) - carry)) {
+            n += carry;
+            u32 whole = complete(buf, n);
+            load(buf, whole);
+            carry = n - whole;
+            memmove(buf, buf + whole, carry);
+        }
+        load(buf, carry);
+    }
+
+    void Source::load(const u8* data, u32 size) {
+        const u8* end = data + size;
+        while (data < end) {
+            const u8* run = data;
+            while (data < end && *data < 128 && *data != '\t' && *data != '\n') 
+                ++ data;
+            if (data != run) append(run, data - run);
+            if (data == end) break;
+            u32 n = uchar(*data).size();
+            if (!n || data + n > end) add(uchar(*data)), n = 1; // invalid utf-8
+            else add(uchar((const char*)data));
+            data += n;
+        }
+        index();
     }
 
     void Source::add(const ustring& line) {
         for (u32 i = 0; i < line.size(); ++ i) add(line[i]);
+        index();
     }
 
-    slice<uchar> Source::line(u32 line) {
+    slice<u8> Source::line(u32 line) {
         u32 start = lines[line], end = line + 1 >= lines.size() ?   
-            text.size() : lines[line + 1];
-        return { end - start, &text[start] };
+            _size : lines[line + 1];
+        return { end - start, (u8*)data(start) };
     }
 
-    const_slice<uchar> Source::line(u32 line) const {
+    const_slice<u8> Source::line(u32 line) const {
         u32 start = lines[line], end = line + 1 >= lines.size() ?   
-            text.size() : lines[line + 1];
-        return { end - start, &text[start] };
+            _size : lines[line + 1];
+        return { end - start, data(start) };
+    }
+
+    u32 Source::lineOf(u32 offset) const {
+        u32 l = 0, h = lines.size();
+        while (h - l > 1) {
+            u32 m = (l + h) / 2;
+            if (lines[m] <= offset) l = m;
+            else h = m;
+        }
+        return l + 1;
+    }
+
+    // tokens never cross a line, so their text is always contiguous
+    const_slice<u8> Source::span(u32 offset, u32 length) const {
+        return { length, data(offset) };
     }
 
     u32 Source::size() const {
-        return text.size();
+        return _size;
     }
 
     Source::View Source::view() const {
@@ -110,6 +339,7 @@ namespace basil {
             add(c);
         }
         if (io.peek() == '\n') add(io.read());
+        index();
         return view;
     }
 }
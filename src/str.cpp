@@ -232,7 +232,7 @@ string operator+(string s, const string& cs) {
 }
 
 void write(stream& io, const string& s) {
-    write(io, s.raw());
+    io.write(s.raw(), s.size());
 }
 
 void read(stream& io, string& s) {
@@ -241,9 +241,9 @@ void read(stream& io, string& s) {
 }
 
 void write(stream& io, const const_slice<u8>& str) {
-    for (u8 c : str) io.write(c);
+    io.write(str.begin(), str.size());
 }
 
 void write(stream& io, const slice<u8>& str) {
-    for (u8 c : str) io.write(c);
+    io.write(str.begin(), str.size());
 }
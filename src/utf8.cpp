@@ -178,6 +178,15 @@ bool isdigit(uchar c) {
     return in(c.point(), DIGITS, NUM_DIGITS);
 }
 
+u32 digitvalue(uchar c) {
+    if (c[0] < 128) return c[0] - '0';
+    u32 p = c.point();
+    if (p >= 0x1369 && p <= 0x1371) return p - 0x1368; // Ethiopic has no zero
+    u32 zero = p;
+    while (p - zero < 9 && in(zero - 1, DIGITS, NUM_DIGITS)) -- zero;
+    return p - zero;
+}
+
 bool isalpha(uchar c) {
     return (c[0] >= 0x0041 && c[0] <= 0x005A)
         || (c[0] >= 0x0061 && c[0] <= 0x007A);
@@ -325,6 +334,10 @@ void ustring::pop() {
     data[_size] = '\0';
 }
 
+void ustring::clear() {
+    while (_size) data[-- _size] = '\0';
+}
+
 u32 ustring::size() const {
     return _size;
 }
@@ -459,12 +472,23 @@ u64 hash(const ustring& s) {
     return raw_hash(s.raw(), sizeof(uchar) * s.size());
 }
 
+static void write_run(stream& io, const uchar* s, u32 n) {
+    u8 buf[256];
+    u32 i = 0;
+    for (const uchar* end = s + n; s != end; ++ s) {
+        if (i + 4 > sizeof(buf)) io.write(buf, i), i = 0;
+        if ((*s)[0] < 128) buf[i ++] = (*s)[0];
+        else for (u32 j = 0; j < s->size(); ++ j) buf[i ++] = (*s)[j];
+    }
+    io.write(buf, i);
+}
+
 void write(stream& io, uchar c) {
-    for (u32 i = 0; i < c.size(); ++ i) io.write(c[i]);
+    io.write(&c[0], c.size());
 }
 
 void write(stream& io, const ustring& s) {
-    for (u32 i = 0; i < s.size(); ++ i) write(io, s[i]);
+    write_run(io, s.raw(), s.size());
 }
 
 void read(stream& io, uchar& c) {
@@ -487,9 +511,9 @@ void read(stream& io, ustring& s) {
 }
 
 void write(stream& io, const const_slice<uchar>& str) {
-    for (uchar c : str) write(io, c);
+    write_run(io, str.begin(), str.size());
 }
 
 void write(stream& io, const slice<uchar>& str) {
-    for (uchar c : str) write(io, c);
+    write_run(io, str.begin(), str.size());
 }